@@ -0,0 +1,66 @@
+#include <os.h>
+#include <time.h>
+#include "zlib.h"
+
+// The four table version of crc32, see CRC32_FOUR in the Makefile
+unsigned long crc32_four(unsigned long crc, const unsigned char* buf, unsigned int len);
+
+// The slicing-by-8 version, built with SLICEBY8
+unsigned long crc32_slice8(unsigned long crc, const unsigned char* buf, unsigned int len)
+{
+	return crc32(crc,buf,len);
+}
+
+double now()
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC,&t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+// Returns the throughput of crc in MB/s, repeating small buffers until the measurement takes long enough
+double measure(unsigned long (*crc)(unsigned long, const unsigned char*, unsigned int), const unsigned char* buffer, unsigned int len, unsigned long* result)
+{
+	unsigned long iterations = 0;
+	double start = now();
+	double elapsed;
+	do
+	{
+		*result = crc(0,buffer,len);
+		iterations++;
+		elapsed = now() - start;
+	} while(elapsed < 0.2);
+	return (double)len * iterations / elapsed / 1e6;
+}
+
+int main()
+{
+	const unsigned int max_len = 1 << 20;
+	// One byte more so that the unaligned runs still have max_len bytes
+	unsigned char* buffer = malloc(max_len + 1);
+	unsigned int i;
+	srand(1);
+	for(i = 0; i < max_len + 1; i++)
+		buffer[i] = rand();
+	
+	printf("%10s %6s %12s %12s %8s\n","bytes","align","four MB/s","slice8 MB/s","speedup");
+	unsigned int len;
+	for(len = 16; len <= max_len; len *= 4)
+	{
+		unsigned int offset;
+		for(offset = 0; offset < 2; offset++)
+		{
+			unsigned long four, slice8;
+			double four_speed = measure(crc32_four,buffer + offset,len,&four);
+			double slice8_speed = measure(crc32_slice8,buffer + offset,len,&slice8);
+			if(four != slice8)
+			{
+				printf("crc mismatch for %u bytes at offset %u: %08lx != %08lx\n",len,offset,four,slice8);
+				return 1;
+			}
+			printf("%10u %6u %12.1f %12.1f %8.2f\n",len,offset,four_speed,slice8_speed,slice8_speed / four_speed);
+		}
+	}
+	free(buffer);
+	return 0;
+}
@@ -0,0 +1,123 @@
+#!/usr/bin/env python3
+# Writes the packages install_bench runs on: two versions of each, <name>-1.pcs.tns
+# and <name>-2.pcs.tns, where the second one changes, removes and adds some files.
+# The output only depends on the seed, so results of different builds compare.
+import os
+import random
+import sys
+import zipfile
+
+TIMESTAMP = 1375988987
+DATE = (2013, 8, 8, 12, 0, 0)
+
+def text(rng, size):
+    words = ["pacspire", "nspire", "package", "install", "file", "data", "level", "sprite", "0", "1", "\n"]
+    out = []
+    length = 0
+    while length < size:
+        word = rng.choice(words)
+        out.append(word)
+        length += len(word) + 1
+    return " ".join(out).encode()[:size]
+
+def noise(rng, size):
+    return bytes(rng.getrandbits(8) for _ in range(size))
+
+# Half random bytes, half runs, deflates to roughly 60%
+def asset(rng, size):
+    out = bytearray()
+    while len(out) < size:
+        out += noise(rng, 64)
+        out += bytes([rng.getrandbits(8)]) * rng.randint(16, 96)
+    return bytes(out[:size])
+
+def tiny(rng):
+    return {"dir%d/f%03d.txt" % (i % 8, i): text(rng, rng.randint(20, 200)) for i in range(400)}, {}
+
+def deep(rng):
+    files = {}
+    path = ""
+    for level in range(12):
+        path += "d%d/" % level
+        for i in range(3):
+            files[path + "f%d.bin" % i] = text(rng, rng.randint(500, 3000))
+    return files, {}
+
+def huge(rng):
+    return {"huge.tns": text(rng, 2000), "data/asset.bin": asset(rng, 3 * 1024 * 1024)}, {}
+
+def stored(rng):
+    return {"img/s%02d.bin" % i: noise(rng, 8192) for i in range(40)}, {"stored": True}
+
+def compressible(rng):
+    return {"txt/t%02d.txt" % i: text(rng, 200) * 1000 for i in range(20)}, {}
+
+def extensions(rng):
+    files = {"exts.tns": text(rng, 4000), "doc/readme.txt": text(rng, 8000)}
+    info = ["ext_name=x%02d\next_prog=exts" % i for i in range(30)]
+    info += ["link_name=Exts\nlink_prog=exts.tns", "link_name=Exts Doc\nlink_prog=doc/readme.txt"]
+    return files, {"pkginfo": "\n".join(info)}
+
+KINDS = [
+    ("bench-tiny", tiny),
+    ("bench-deep", deep),
+    ("bench-huge", huge),
+    ("bench-stored", stored),
+    ("bench-text", compressible),
+    ("bench-exts", extensions),
+]
+
+# Every tenth file changes, every twentieth is dropped and as many new ones appear
+def nextVersion(rng, files):
+    names = sorted(files)
+    changed = dict(files)
+    for i, name in enumerate(names):
+        if i % 20 == 19:
+            del changed[name]
+            head, _, tail = name.rpartition("/")
+            changed[(head + "/" if head else "") + "n" + tail] = files[name]
+        elif i % 10 == 0:
+            data = bytearray(files[name])
+            data[len(data) // 2] ^= 0x55
+            changed[name] = bytes(data)
+    return changed
+
+def writePackage(path, name, version, timestamp, files, options):
+    method = zipfile.ZIP_STORED if options.get("stored") else zipfile.ZIP_DEFLATED
+    info = "name=%s\nversion=%s\ntimestamp=%d\n" % (name, version, timestamp)
+    if "pkginfo" in options:
+        info += options["pkginfo"] + "\n"
+    with zipfile.ZipFile(path, "w") as z:
+        entry = zipfile.ZipInfo("pkginfo.txt.tns", DATE)
+        entry.compress_type = zipfile.ZIP_DEFLATED
+        z.writestr(entry, info)
+        dirs = set()
+        for file in sorted(files):
+            # deep trees list their directories, the others leave them out
+            if name == "bench-deep":
+                parts = file.split("/")[:-1]
+                for i in range(1, len(parts) + 1):
+                    d = "/".join(parts[:i]) + "/"
+                    if d not in dirs:
+                        dirs.add(d)
+                        z.writestr(zipfile.ZipInfo(d, DATE), b"")
+            entry = zipfile.ZipInfo(file, DATE)
+            entry.compress_type = method
+            z.writestr(entry, files[file])
+
+def main():
+    if len(sys.argv) < 2:
+        print("usage: gencorpus.py <output directory> [seed]")
+        return 1
+    out = sys.argv[1]
+    seed = int(sys.argv[2]) if len(sys.argv) > 2 else 1
+    os.makedirs(out, exist_ok=True)
+    for name, kind in KINDS:
+        rng = random.Random("%s-%d" % (name, seed))
+        files, options = kind(rng)
+        writePackage(os.path.join(out, name + "-1.pcs.tns"), name, "1.0", TIMESTAMP, files, options)
+        writePackage(os.path.join(out, name + "-2.pcs.tns"), name, "2.0", TIMESTAMP + 86400, nextVersion(rng, files), options)
+    return 0
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,67 @@
+#include <os.h>
+#include <malloc.h>
+
+// Linked into pacspire_heap with -Wl,--wrap for malloc, calloc, realloc and free
+// (see the Makefile) to find the peak of the heap pacspire itself allocates,
+// written to the file named by PACSPIRE_HEAP when it exits
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* p, size_t size);
+void __real_free(void* p);
+
+static size_t current;
+static size_t peak;
+
+static void allocated(void* p)
+{
+	if(p == NULL)
+		return;
+	current += malloc_usable_size(p);
+	if(current > peak)
+		peak = current;
+}
+
+void* __wrap_malloc(size_t size)
+{
+	void* p = __real_malloc(size);
+	allocated(p);
+	return p;
+}
+
+void* __wrap_calloc(size_t count, size_t size)
+{
+	void* p = __real_calloc(count,size);
+	allocated(p);
+	return p;
+}
+
+void* __wrap_realloc(void* p, size_t size)
+{
+	size_t old = p != NULL ? malloc_usable_size(p) : 0;
+	void* q = __real_realloc(p,size);
+	if(q != NULL || size == 0)
+	{
+		current -= old;
+		allocated(q);
+	}
+	return q;
+}
+
+void __wrap_free(void* p)
+{
+	if(p != NULL)
+		current -= malloc_usable_size(p);
+	__real_free(p);
+}
+
+__attribute__((destructor)) static void report(void)
+{
+	const char* file = getenv("PACSPIRE_HEAP");
+	if(file == NULL)
+		return;
+	FILE* f = fopen(file,"w");
+	if(f == NULL)
+		return;
+	fprintf(f,"%lu\n",(unsigned long)peak);
+	fclose(f);
+}
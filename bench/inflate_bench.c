@@ -0,0 +1,111 @@
+#include <os.h>
+#include <time.h>
+#include "zlib.h"
+#include "unzip.h"
+
+// Both versions of inflate_fast are linked in under other names, see the Makefile.
+// inflate() calls the one selected here.
+void inflate_fast_byte(z_streamp strm, unsigned start);
+void inflate_fast_wide(z_streamp strm, unsigned start);
+void (*selected_inflate_fast)(z_streamp, unsigned);
+
+void inflate_fast(z_streamp strm, unsigned start)
+{
+	selected_inflate_fast(strm,start);
+}
+
+double now()
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC,&t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+// Extracts every deflated entry of the package the way pacspire does, checking the crc.
+// Adds the uncompressed bytes to total, returns -1 on error.
+int extractAll(const char* file, char* buffer, unsigned int buffer_size, unsigned long* total)
+{
+	zlib_filefunc64_def filefunc;
+	zlib_mem_def mem;
+	mem.max_size = 64 * 1024 * 1024;
+	fill_memory_filefunc64(&filefunc,&mem);
+	unzFile uf = unzOpen2_64(file,&filefunc);
+	if(uf == NULL)
+		return -1;
+	unzSetReadBufferSize(uf,8192);
+	unzSetCrcCheck(uf,0);
+	unzSetStreamReuse(uf,1);
+	
+	int err = unzGoToFirstFile(uf);
+	while(err == UNZ_OK)
+	{
+		unz_file_info64 file_info;
+		unzGetCurrentFileInfo64(uf,&file_info,NULL,0,NULL,0,NULL,0);
+		if(file_info.compression_method == Z_DEFLATED)
+		{
+			if(unzOpenCurrentFile(uf) != UNZ_OK)
+				break;
+			uLong crc = crc32(0,Z_NULL,0);
+			int count;
+			while((count = unzReadCurrentFile(uf,buffer,buffer_size)) > 0)
+			{
+				crc = crc32(crc,(Bytef*)buffer,count);
+				*total += count;
+			}
+			unzCloseCurrentFile(uf);
+			if(count < 0 || crc != file_info.crc)
+				break;
+		}
+		err = unzGoToNextFile(uf);
+	}
+	unzClose(uf);
+	return err == UNZ_END_OF_LIST_OF_FILE ? 0 : -1;
+}
+
+// Returns the best throughput of a few runs over all packages in MB/s
+double measure(int count, char** files, char* buffer, unsigned int buffer_size, unsigned long* total)
+{
+	double best = 0;
+	int run;
+	for(run = 0; run < 5; run++)
+	{
+		*total = 0;
+		double start = now();
+		int i;
+		for(i = 0; i < count; i++)
+		{
+			if(extractAll(files[i],buffer,buffer_size,total) == -1)
+			{
+				printf("failed to extract %s\n",files[i]);
+				return 0;
+			}
+		}
+		double speed = *total / (now() - start) / 1e6;
+		if(speed > best)
+			best = speed;
+	}
+	return best;
+}
+
+int main(int argc, char** argv)
+{
+	if(argc < 2)
+	{
+		printf("usage: %s package...\n",argv[0]);
+		return 1;
+	}
+	
+	static char buffer[8192]; // EXTRACT_BUFFER_SIZE of pacspire
+	unsigned long byte_total, wide_total;
+	selected_inflate_fast = inflate_fast_byte;
+	double byte_speed = measure(argc - 1,argv + 1,buffer,sizeof(buffer),&byte_total);
+	selected_inflate_fast = inflate_fast_wide;
+	double wide_speed = measure(argc - 1,argv + 1,buffer,sizeof(buffer),&wide_total);
+	if(byte_speed == 0 || wide_speed == 0 || byte_total != wide_total)
+		return 1;
+	
+	printf("%d packages, %lu bytes inflated, CRCs match\n",argc - 1,byte_total);
+	printf("%12s %12s %8s\n","byte MB/s","wide MB/s","speedup");
+	printf("%12.1f %12.1f %8.2f\n",byte_speed,wide_speed,wide_speed / byte_speed);
+	return 0;
+}
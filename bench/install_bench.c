@@ -0,0 +1,409 @@
+#include <os.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <sys/ptrace.h>
+#ifdef __x86_64__
+#include <sys/user.h>
+#include <sys/syscall.h>
+#endif
+
+// Runs the install, upgrade and remove paths of the Linux build of pacspire on the
+// packages written by gencorpus.py, each in a fresh directory standing in for the
+// calculator. Every operation is timed over several runs, and run once more under
+// ptrace to count its system calls and the bytes it writes to files. The peak heap
+// comes from pacspire_heap, see heapcount.c. Results are written as JSON.
+
+#define MAX_PACKAGES 32
+
+enum
+{
+	OP_INSTALL,
+	OP_UPGRADE, // installs version 1 first, untimed
+	OP_REMOVE, // installs version 1 first, untimed
+	OP_COUNT
+};
+
+static const char* op_names[] = {"install","upgrade","remove"};
+
+#ifdef __x86_64__
+static const struct
+{
+	long number;
+	const char* name;
+} tracked[] = {
+	{SYS_read,"read"},{SYS_write,"write"},{SYS_open,"open"},{SYS_openat,"openat"},{SYS_close,"close"},
+	{SYS_lseek,"lseek"},{SYS_stat,"stat"},{SYS_fstat,"fstat"},{SYS_newfstatat,"newfstatat"},
+	{SYS_mkdir,"mkdir"},{SYS_unlink,"unlink"},{SYS_rmdir,"rmdir"},{SYS_rename,"rename"},
+	{SYS_getdents64,"getdents64"},{SYS_clock_gettime,"clock_gettime"},{SYS_brk,"brk"},{SYS_mmap,"mmap"},{SYS_munmap,"munmap"}
+};
+#define TRACKED (sizeof(tracked) / sizeof(tracked[0]))
+#else
+#define TRACKED 0
+#endif
+
+typedef struct
+{
+	int ok;
+	double wall_min;
+	double wall_median;
+	long syscalls; // -1 where they cannot be traced
+	long counts[TRACKED + 1]; // the last one counts the others
+	long bytes_written;
+	long peak_heap;
+} result;
+
+static const char* pacspire;
+static char work[64];
+
+double now()
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC,&t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+void removeTree(const char* path)
+{
+	DIR* dir = opendir(path);
+	if(dir == NULL)
+	{
+		unlink(path);
+		return;
+	}
+	struct dirent* entry;
+	while((entry = readdir(dir)) != NULL)
+	{
+		if(strcmp(entry->d_name,".") == 0 || strcmp(entry->d_name,"..") == 0)
+			continue;
+		char child[300];
+		snprintf(child,sizeof(child),"%s/%s",path,entry->d_name);
+		removeTree(child);
+	}
+	closedir(dir);
+	rmdir(path);
+}
+
+int copyFile(const char* from, const char* to)
+{
+	FILE* in = fopen(from,"rb");
+	if(in == NULL)
+		return -1;
+	FILE* out = fopen(to,"wb");
+	if(out == NULL)
+	{
+		fclose(in);
+		return -1;
+	}
+	
+	char buffer[65536];
+	size_t count;
+	while((count = fread(buffer,1,sizeof(buffer),in)) > 0)
+		fwrite(buffer,1,count,out);
+	fclose(in);
+	return fclose(out);
+}
+
+// Empties the calculator directory and puts both versions of the package into /documents
+int freshCalculator(const char* corpus, const char* name)
+{
+	removeTree(work);
+	char path[300];
+	mkdir(work,0755);
+	sprintf(path,"%s/pacspire",work);
+	mkdir(path,0755);
+	sprintf(path,"%s/documents",work);
+	mkdir(path,0755);
+	sprintf(path,"%s/documents/ndless",work);
+	mkdir(path,0755);
+	sprintf(path,"%s/documents/ndless/ndless.cfg.tns",work);
+	FILE* f = fopen(path,"wb");
+	if(f == NULL)
+		return -1;
+	fputs("ext.pcs=pacspire\next.lnk=pacspire\n",f);
+	fclose(f);
+	
+	int version;
+	for(version = 1; version <= 2; version++)
+	{
+		char from[300];
+		sprintf(from,"%s/%s-%d.pcs.tns",corpus,name,version);
+		sprintf(path,"%s/documents/%s-%d.pcs.tns",work,name,version);
+		if(copyFile(from,path) != 0)
+			return -1;
+	}
+	return 0;
+}
+
+// Starts pacspire with the calculator directory, no input and no output
+pid_t start(char** args, int traced, const char* heap_file)
+{
+	pid_t pid = fork();
+	if(pid != 0)
+		return pid;
+	
+	int null = open("/dev/null",O_RDWR);
+	dup2(null,STDIN_FILENO);
+	dup2(null,STDOUT_FILENO);
+	dup2(null,STDERR_FILENO);
+	setenv("PACSPIRE_FS",work,1);
+	if(heap_file != NULL)
+		setenv("PACSPIRE_HEAP",heap_file,1);
+	if(traced)
+		ptrace(PTRACE_TRACEME,0,NULL,NULL);
+	execv(pacspire,args);
+	_exit(127);
+}
+
+int run(char** args)
+{
+	int status;
+	waitpid(start(args,0,NULL),&status,0);
+	return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : -1;
+}
+
+// Counts the system calls of one run, and the bytes written to files (not stdin, stdout or stderr)
+void trace(char** args, result* r)
+{
+	char heap_file[100];
+	sprintf(heap_file,"%s.heap",work);
+	unlink(heap_file);
+	r->syscalls = -1;
+	r->bytes_written = -1;
+	memset(r->counts,0,sizeof(r->counts));
+	
+	#ifdef __x86_64__
+	pid_t pid = start(args,1,heap_file);
+	int status;
+	waitpid(pid,&status,0); // stopped at the exec
+	if(WIFSTOPPED(status) && ptrace(PTRACE_SETOPTIONS,pid,NULL,PTRACE_O_TRACESYSGOOD) == 0)
+	{
+		r->syscalls = 0;
+		r->bytes_written = 0;
+		int entering = 1;
+		int signal = 0;
+		while(ptrace(PTRACE_SYSCALL,pid,NULL,signal) == 0 && waitpid(pid,&status,0) == pid && WIFSTOPPED(status))
+		{
+			signal = 0;
+			if(WSTOPSIG(status) != (SIGTRAP | 0x80))
+			{
+				signal = WSTOPSIG(status);
+				continue;
+			}
+			if(entering)
+			{
+				struct user_regs_struct regs;
+				ptrace(PTRACE_GETREGS,pid,NULL,&regs);
+				unsigned int i;
+				for(i = 0; i < TRACKED && tracked[i].number != (long)regs.orig_rax; i++)
+					;
+				r->counts[i]++;
+				r->syscalls++;
+				if((regs.orig_rax == SYS_write || regs.orig_rax == SYS_pwrite64) && regs.rdi > 2)
+					r->bytes_written += regs.rdx;
+			}
+			entering = !entering;
+		}
+	}
+	else
+		kill(pid,SIGKILL);
+	waitpid(pid,&status,0);
+	#else
+	run(args);
+	#endif
+	
+	r->peak_heap = -1;
+	FILE* f = fopen(heap_file,"r");
+	if(f != NULL)
+	{
+		if(fscanf(f,"%ld",&r->peak_heap) != 1)
+			r->peak_heap = -1;
+		fclose(f);
+	}
+	unlink(heap_file);
+}
+
+int compareTimes(const void* a, const void* b)
+{
+	double d = *(const double*)a - *(const double*)b;
+	return d < 0 ? -1 : d > 0;
+}
+
+// Whether the package is installed afterwards in the version it should be
+int check(const char* name, int op)
+{
+	char path[300];
+	sprintf(path,"%s/pacspire/%s/pkginfo.txt.tns",work,name);
+	FILE* f = fopen(path,"rb");
+	if(op == OP_REMOVE)
+	{
+		if(f != NULL)
+			fclose(f);
+		return f == NULL;
+	}
+	if(f == NULL)
+		return 0;
+	char info[512];
+	size_t len = fread(info,1,sizeof(info) - 1,f);
+	info[len] = '\0';
+	fclose(f);
+	return strstr(info,op == OP_INSTALL ? "version=1.0" : "version=2.0") != NULL;
+}
+
+int measure(const char* corpus, const char* name, int op, int runs, result* r)
+{
+	char package[100];
+	sprintf(package,"/documents/%s-%d.pcs.tns",name,op == OP_UPGRADE ? 2 : 1);
+	char first[100];
+	sprintf(first,"/documents/%s-1.pcs.tns",name);
+	char* setup[] = {(char*)pacspire,"-q",first,NULL};
+	char* install[] = {(char*)pacspire,"-q",package,NULL};
+	char* removal[] = {(char*)pacspire,"-q","remove",(char*)name,NULL};
+	char** args = op == OP_REMOVE ? removal : install;
+	
+	double times[runs];
+	int i;
+	for(i = 0; i <= runs; i++)
+	{
+		if(freshCalculator(corpus,name) != 0)
+			return -1;
+		if(op != OP_INSTALL && run(setup) != 0)
+			return -1;
+		if(i == runs)
+		{
+			trace(args,r);
+			r->ok = check(name,op);
+			break;
+		}
+		double t = now();
+		run(args);
+		times[i] = now() - t;
+		if(!check(name,op))
+		{
+			r->ok = 0;
+			return 0;
+		}
+	}
+	
+	qsort(times,runs,sizeof(double),compareTimes);
+	r->wall_min = times[0] * 1000;
+	r->wall_median = times[runs / 2] * 1000;
+	return 0;
+}
+
+int compareNames(const void* a, const void* b)
+{
+	return strcmp((const char*)a,(const char*)b);
+}
+
+int findPackages(const char* corpus, char names[][40])
+{
+	DIR* dir = opendir(corpus);
+	if(dir == NULL)
+		return -1;
+	int count = 0;
+	struct dirent* entry;
+	while((entry = readdir(dir)) != NULL && count < MAX_PACKAGES)
+	{
+		int len = strlen(entry->d_name) - strlen("-1.pcs.tns");
+		if(len < 1 || len >= 40 || strcmp(entry->d_name + len,"-1.pcs.tns") != 0)
+			continue;
+		memcpy(names[count],entry->d_name,len);
+		names[count][len] = '\0';
+		count++;
+	}
+	closedir(dir);
+	qsort(names,count,sizeof(names[0]),compareNames);
+	return count;
+}
+
+void writeResult(FILE* f, const char* name, int op, const result* r, int last)
+{
+	fprintf(f,"  {\"package\": \"%s\", \"operation\": \"%s\", \"ok\": %s",name,op_names[op],r->ok ? "true" : "false");
+	if(r->ok)
+	{
+		fprintf(f,", \"wall_ms_min\": %.3f, \"wall_ms_median\": %.3f",r->wall_min,r->wall_median);
+		fprintf(f,", \"bytes_written\": %ld, \"peak_heap\": %ld",r->bytes_written,r->peak_heap);
+		if(r->syscalls >= 0)
+		{
+			fprintf(f,", \"syscalls\": {\"total\": %ld",r->syscalls);
+			#ifdef __x86_64__
+			unsigned int i;
+			for(i = 0; i < TRACKED; i++)
+				if(r->counts[i] > 0)
+					fprintf(f,", \"%s\": %ld",tracked[i].name,r->counts[i]);
+			#endif
+			fprintf(f,", \"other\": %ld}",r->counts[TRACKED]);
+		}
+		else
+			fprintf(f,", \"syscalls\": null");
+	}
+	fprintf(f,"}%s\n",last ? "" : ",");
+}
+
+int main(int argc, char** argv)
+{
+	int runs = 5;
+	const char* output = NULL;
+	int opt;
+	while((opt = getopt(argc,argv,"n:o:")) != -1)
+	{
+		if(opt == 'n')
+			runs = atoi(optarg);
+		else if(opt == 'o')
+			output = optarg;
+	}
+	if(argc - optind != 2 || runs < 1)
+	{
+		fprintf(stderr,"usage: install_bench [-n runs] [-o results.json] <pacspire> <corpus directory>\n");
+		return 1;
+	}
+	pacspire = argv[optind];
+	const char* corpus = argv[optind + 1];
+	
+	char names[MAX_PACKAGES][40];
+	int count = findPackages(corpus,names);
+	if(count <= 0)
+	{
+		fprintf(stderr,"no <name>-1.pcs.tns packages in %s\n",corpus);
+		return 1;
+	}
+	
+	strcpy(work,"/tmp/pacspire-bench-XXXXXX");
+	if(mkdtemp(work) == NULL)
+		return 1;
+	
+	FILE* f = output != NULL ? fopen(output,"w") : stdout;
+	if(f == NULL)
+		return 1;
+	fprintf(f,"[\n");
+	fprintf(stderr,"%-14s %-8s %10s %10s %10s %10s\n","package","op","ms","syscalls","written","heap");
+	int failed = 0;
+	int i;
+	for(i = 0; i < count; i++)
+	{
+		int op;
+		for(op = 0; op < OP_COUNT; op++)
+		{
+			result r;
+			memset(&r,0,sizeof(r));
+			if(measure(corpus,names[i],op,runs,&r) != 0)
+				r.ok = 0;
+			if(r.ok)
+				fprintf(stderr,"%-14s %-8s %10.2f %10ld %10ld %10ld\n",names[i],op_names[op],r.wall_median,r.syscalls,r.bytes_written,r.peak_heap);
+			else
+			{
+				fprintf(stderr,"%-14s %-8s failed\n",names[i],op_names[op]);
+				failed++;
+			}
+			writeResult(f,names[i],op,&r,i == count - 1 && op == OP_COUNT - 1);
+		}
+	}
+	fprintf(f,"]\n");
+	if(f != stdout)
+		fclose(f);
+	
+	removeTree(work);
+	return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,83 @@
+#include <os.h>
+#include <time.h>
+#include "pkginfo.h"
+
+// Builds a pkginfo with the given number of extensions and links
+char* generatePackageInfo(int ext_count, int link_count)
+{
+	char* buffer = malloc(64 + ext_count * 48 + link_count * 64);
+	char* p = buffer;
+	p += sprintf(p,"name=bench\r\nversion=1.0\r\ntimestamp=1375988987\r\n");
+	
+	int i;
+	for(i = 0; i < ext_count; i++)
+		p += sprintf(p,"ext_name=e%d\r\next_prog=prog%d\r\n",i,i % 100);
+	for(i = 0; i < link_count; i++)
+		p += sprintf(p,"link_name=Link %d\r\nlink_prog=prog%d\r\n",i,i % 100);
+	return buffer;
+}
+
+double now()
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC,&t);
+	return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+int main()
+{
+	static const int sizes[][2] = {{0,0},{1,1},{10,2},{100,10},{1000,100},{10000,1000}};
+	
+	printf("%8s %8s %10s %12s %10s %10s %12s\n","exts","links","bytes","us/parse","MB/s","record","us/record");
+	unsigned int i;
+	for(i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+	{
+		char* buffer = generatePackageInfo(sizes[i][0],sizes[i][1]);
+		size_t len = strlen(buffer);
+		
+		// Repeat small inputs until the measurement takes long enough
+		int iterations = 0;
+		double start = now();
+		double elapsed;
+		do
+		{
+			pkginfo* p = parsePackageInfo(buffer);
+			if(p == NULL || p->ext_count != sizes[i][0] || p->link_count != sizes[i][1])
+			{
+				printf("parse failed for %d extensions, %d links\n",sizes[i][0],sizes[i][1]);
+				return 1;
+			}
+			freePackageInfo(p);
+			iterations++;
+			elapsed = now() - start;
+		} while(elapsed < 0.2);
+		
+		double per_parse = elapsed / iterations;
+		
+		// The same pkginfo as the record pcsbuild writes into the comment of a package
+		pkginfo* p = parsePackageInfo(buffer);
+		char* record = malloc(len);
+		int record_size = writePackageRecord(record,len,p);
+		freePackageInfo(p);
+		iterations = 0;
+		start = now();
+		do
+		{
+			p = parsePackageRecord(record,record_size);
+			if(p == NULL || p->ext_count != sizes[i][0] || p->link_count != sizes[i][1])
+			{
+				printf("record failed for %d extensions, %d links\n",sizes[i][0],sizes[i][1]);
+				return 1;
+			}
+			freePackageInfo(p);
+			iterations++;
+			elapsed = now() - start;
+		} while(elapsed < 0.2);
+		
+		printf("%8d %8d %10lu %12.2f %10.1f %10d %12.2f\n",sizes[i][0],sizes[i][1],(unsigned long)len,per_parse * 1e6,len / per_parse / 1e6,
+			record_size,elapsed / iterations * 1e6);
+		free(record);
+		free(buffer);
+	}
+	return 0;
+}
@@ -0,0 +1,15 @@
+// Stand-in for the Ndless os.h so that the sources build on a PC, for the
+// benchmarks and the Linux build. Everything Ndless specific goes through platform.h.
+#ifndef HOST_OS_H
+#define HOST_OS_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#endif
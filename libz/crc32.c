@@ -11,6 +11,13 @@
 
 /* @(#) $Id$ */
 
+/*
+  Note on SLICEBY8: when defined (see Makefile), crc32_little() consumes eight
+  bytes per step using four more tables of 256 entries (CRC of each byte value
+  followed by four to seven zeros).  The tables are compiled in from crc32.h
+  like the others, unless DYNAMIC_CRC_TABLE is also defined.
+ */
+
 /*
   Note on the use of DYNAMIC_CRC_TABLE: there is no mutex or semaphore
   protection on the static variables used to control the first-use generation
@@ -59,7 +66,11 @@
                         const unsigned char FAR *, unsigned));
    local unsigned long crc32_big OF((unsigned long,
                         const unsigned char FAR *, unsigned));
-#  define TBLS 8
+#  ifdef SLICEBY8
+#    define TBLS 12
+#  else
+#    define TBLS 8
+#  endif
 #else
 #  define TBLS 1
 #endif /* BYFOUR */
@@ -103,7 +114,8 @@ local void make_crc_table OF((void));
   all the information needed to generate CRCs on data a byte at a time for all
   combinations of CRC register values and incoming bytes.  The remaining tables
   allow for word-at-a-time CRC calculation for both big-endian and little-
-  endian machines, where a word is four bytes.
+  endian machines, where a word is four bytes.  With SLICEBY8, four more
+  little-endian tables continue the first four up to seven trailing zeros.
 */
 local void make_crc_table()
 {
@@ -144,6 +156,12 @@ local void make_crc_table()
                 crc_table[k][n] = c;
                 crc_table[k + 4][n] = REV(c);
             }
+#ifdef SLICEBY8
+            for (k = 8; k < 12; k++) {
+                c = crc_table[0][c & 0xff] ^ (c >> 8);
+                crc_table[k][n] = c;
+            }
+#endif /* SLICEBY8 */
         }
 #endif /* BYFOUR */
 
@@ -173,6 +191,14 @@ local void make_crc_table()
             fprintf(out, "  },\n  {\n");
             write_table(out, crc_table[k]);
         }
+#    ifdef SLICEBY8
+        fprintf(out, "#ifdef SLICEBY8\n");
+        for (k = 8; k < 12; k++) {
+            fprintf(out, "  },\n  {\n");
+            write_table(out, crc_table[k]);
+        }
+        fprintf(out, "#endif\n");
+#    endif /* SLICEBY8 */
         fprintf(out, "#endif\n");
 #  endif /* BYFOUR */
         fprintf(out, "  }\n};\n");
@@ -259,6 +285,15 @@ unsigned long ZEXPORT crc32(crc, buf, len)
         c = crc_table[3][c & 0xff] ^ crc_table[2][(c >> 8) & 0xff] ^ \
             crc_table[1][(c >> 16) & 0xff] ^ crc_table[0][c >> 24]
 #define DOLIT32 DOLIT4; DOLIT4; DOLIT4; DOLIT4; DOLIT4; DOLIT4; DOLIT4; DOLIT4
+#ifdef SLICEBY8
+#  define DOLIT8 c ^= *buf4++; \
+        c = crc_table[11][c & 0xff] ^ crc_table[10][(c >> 8) & 0xff] ^ \
+            crc_table[9][(c >> 16) & 0xff] ^ crc_table[8][c >> 24] ^ \
+            crc_table[3][*buf4 & 0xff] ^ crc_table[2][(*buf4 >> 8) & 0xff] ^ \
+            crc_table[1][(*buf4 >> 16) & 0xff] ^ crc_table[0][*buf4 >> 24]; \
+        buf4++
+#  define DOLIT32_8 DOLIT8; DOLIT8; DOLIT8; DOLIT8
+#endif /* SLICEBY8 */
 
 /* ========================================================================= */
 local unsigned long crc32_little(crc, buf, len)
@@ -277,10 +312,21 @@ local unsigned long crc32_little(crc, buf, len)
     }
 
     buf4 = (const u4 FAR *)(const void FAR *)buf;
+#ifdef SLICEBY8
+    while (len >= 32) {
+        DOLIT32_8;
+        len -= 32;
+    }
+    while (len >= 8) {
+        DOLIT8;
+        len -= 8;
+    }
+#else /* !SLICEBY8 */
     while (len >= 32) {
         DOLIT32;
         len -= 32;
     }
+#endif /* SLICEBY8 */
     while (len >= 4) {
         DOLIT4;
         len -= 4;
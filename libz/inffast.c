@@ -8,7 +8,8 @@
 #include "inflate.h"
 #include "inffast.h"
 
-#ifndef ASMINF
+/* with INFFAST_WIDE, inflate_fast() comes from inffastw.c instead */
+#if !defined(ASMINF) && !defined(INFFAST_WIDE)
 
 /* Allow machine dependent optimization for post-increment or pre-increment.
    Based on testing to date,
@@ -337,4 +338,4 @@ unsigned start;         /* inflate()'s starting value for strm->avail_out */
    - Moving len -= 3 statement into middle of loop
  */
 
-#endif /* !ASMINF */
+#endif /* !ASMINF && !INFFAST_WIDE */
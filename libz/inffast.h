@@ -8,4 +8,11 @@
    subject to change. Applications should only use zlib.h.
  */
 
+/* input inflate() must have available before calling inflate_fast() */
+#ifdef INFFAST_WIDE
+#  define INFLATE_FAST_MIN_HAVE 11  /* see inffastw.c */
+#else
+#  define INFLATE_FAST_MIN_HAVE 6
+#endif
+
 void ZLIB_INTERNAL inflate_fast OF((z_streamp strm, unsigned start));
@@ -0,0 +1,437 @@
+/* inffastw.c -- fast decoding with word sized refills and copies
+ * Copyright (C) 1995-2008, 2010 Mark Adler
+ * For conditions of distribution and use, see copyright notice in zlib.h
+ */
+
+/*
+   This is inffast.c reworked for cores without unaligned loads and with cheap
+   multi-word loads and stores, like the ARM9 of the TI-Nspire.  It is built
+   instead of inffast.c when INFFAST_WIDE is defined, and gives the same
+   output.  The differences are:
+
+    - The bit buffer is refilled with four bytes at once up to 24..31 bits,
+      instead of with two single bytes.  The bytes loaded beyond the ones
+      counted in bits are the next input bytes, so or-ing them in again on
+      the next refill leaves hold unchanged.  This makes inflate_fast() look
+      further ahead in the input, see INFLATE_FAST_MIN_HAVE in inffast.h.
+
+    - Matches are copied a word at a time when source and destination have
+      the same alignment, four words per step when they do not overlap
+      within those sixteen bytes.  Long non-overlapping matches with
+      different alignments go to zmemcpy(), distance one runs are filled
+      with words.
+ */
+
+#include <limits.h>
+#include "zutil.h"
+#include "inftrees.h"
+#include "inflate.h"
+#include "inffast.h"
+
+#if defined(INFFAST_WIDE) && !defined(ASMINF)
+
+#if (UINT_MAX == 0xffffffffUL)
+   typedef unsigned int u4;
+#else
+   typedef unsigned long u4;
+#endif
+
+/* next four input bytes in stream order, loaded bytewise since in is not
+   necessarily aligned */
+#define LOAD4(p) ((unsigned long)(p)[0] | ((unsigned long)(p)[1] << 8) | \
+                  ((unsigned long)(p)[2] << 16) | ((unsigned long)(p)[3] << 24))
+
+/* fill hold up to 24..31 bits, reading at most four bytes at in */
+#define REFILL() \
+    do { \
+        hold |= LOAD4(in) << bits; \
+        in += (31 - bits) >> 3; \
+        bits |= 24; \
+    } while (0)
+
+local unsigned char FAR *copy_bytes OF((unsigned char FAR *out,
+                        const unsigned char FAR *from, unsigned len));
+local unsigned char FAR *copy_match OF((unsigned char FAR *out,
+                        unsigned dist, unsigned len));
+
+/* copy len bytes from from to out, the two must not overlap */
+local unsigned char FAR *copy_bytes(out, from, len)
+unsigned char FAR *out;
+const unsigned char FAR *from;
+unsigned len;
+{
+    if ((((ptrdiff_t)out ^ (ptrdiff_t)from) & 3) == 0) {
+        while (len && ((ptrdiff_t)out & 3)) {
+            *out++ = *from++;
+            len--;
+        }
+        while (len >= 16) {
+            u4 a, b, c, d;
+            a = ((const u4 FAR *)from)[0];
+            b = ((const u4 FAR *)from)[1];
+            c = ((const u4 FAR *)from)[2];
+            d = ((const u4 FAR *)from)[3];
+            ((u4 FAR *)out)[0] = a;
+            ((u4 FAR *)out)[1] = b;
+            ((u4 FAR *)out)[2] = c;
+            ((u4 FAR *)out)[3] = d;
+            out += 16;
+            from += 16;
+            len -= 16;
+        }
+        while (len >= 4) {
+            *(u4 FAR *)out = *(const u4 FAR *)from;
+            out += 4;
+            from += 4;
+            len -= 4;
+        }
+    }
+    else if (len >= 32) {
+        zmemcpy(out, from, len);
+        return out + len;
+    }
+    while (len > 2) {
+        *out++ = *from++;
+        *out++ = *from++;
+        *out++ = *from++;
+        len -= 3;
+    }
+    if (len) {
+        *out++ = *from++;
+        if (len > 1)
+            *out++ = *from++;
+    }
+    return out;
+}
+
+/* copy a match of len bytes starting dist bytes back in the output, where
+   the bytes repeat when dist < len */
+local unsigned char FAR *copy_match(out, dist, len)
+unsigned char FAR *out;
+unsigned dist;
+unsigned len;
+{
+    const unsigned char FAR *from;
+
+    if (dist >= len)
+        return copy_bytes(out, out - dist, len);
+    from = out - dist;
+    if (dist == 1) {                    /* run of a single byte */
+        u4 fill;
+
+        fill = *from * 0x01010101UL;
+        while (len && ((ptrdiff_t)out & 3)) {
+            *out++ = (unsigned char)fill;
+            len--;
+        }
+        while (len >= 16) {
+            ((u4 FAR *)out)[0] = fill;
+            ((u4 FAR *)out)[1] = fill;
+            ((u4 FAR *)out)[2] = fill;
+            ((u4 FAR *)out)[3] = fill;
+            out += 16;
+            len -= 16;
+        }
+        while (len >= 4) {
+            *(u4 FAR *)out = fill;
+            out += 4;
+            len -= 4;
+        }
+        while (len) {
+            *out++ = (unsigned char)fill;
+            len--;
+        }
+        return out;
+    }
+    if ((dist & 3) == 0) {              /* words, each read after it was
+                                           written since dist >= 4 */
+        while (len && ((ptrdiff_t)out & 3)) {
+            *out++ = *from++;
+            len--;
+        }
+        if (dist >= 16)
+            while (len >= 16) {
+                u4 a, b, c, d;
+                a = ((const u4 FAR *)from)[0];
+                b = ((const u4 FAR *)from)[1];
+                c = ((const u4 FAR *)from)[2];
+                d = ((const u4 FAR *)from)[3];
+                ((u4 FAR *)out)[0] = a;
+                ((u4 FAR *)out)[1] = b;
+                ((u4 FAR *)out)[2] = c;
+                ((u4 FAR *)out)[3] = d;
+                out += 16;
+                from += 16;
+                len -= 16;
+            }
+        while (len >= 4) {
+            *(u4 FAR *)out = *(const u4 FAR *)from;
+            out += 4;
+            from += 4;
+            len -= 4;
+        }
+    }
+    while (len > 2) {
+        *out++ = *from++;
+        *out++ = *from++;
+        *out++ = *from++;
+        len -= 3;
+    }
+    if (len) {
+        *out++ = *from++;
+        if (len > 1)
+            *out++ = *from++;
+    }
+    return out;
+}
+
+/*
+   Decode literal, length, and distance codes and write out the resulting
+   literal and match bytes until either not enough input or output is
+   available, an end-of-block is encountered, or a data error is encountered.
+   The entry assumptions and return states are those of inffast.c, except
+   that strm->avail_in >= INFLATE_FAST_MIN_HAVE.
+
+   Notes:
+
+    - A length/distance pair uses at most 48 bits, and a refill leaves at
+      most 31 bits in hold, so one loop advances in by at most 9 bytes.  The
+      last refill of a loop happens with fewer than 15 bits in hold, after at
+      least two bytes were counted, and reads four bytes.  So a loop reads at
+      most 11 bytes past its starting in.
+
+    - Like in inffast.c, a single length/distance pair outputs at most 258
+      bytes, and the copies never write past the end of the match.
+ */
+void ZLIB_INTERNAL inflate_fast(strm, start)
+z_streamp strm;
+unsigned start;         /* inflate()'s starting value for strm->avail_out */
+{
+    struct inflate_state FAR *state;
+    unsigned char FAR *in;      /* local strm->next_in */
+    unsigned char FAR *last;    /* while in < last, enough input available */
+    unsigned char FAR *out;     /* local strm->next_out */
+    unsigned char FAR *beg;     /* inflate()'s initial strm->next_out */
+    unsigned char FAR *end;     /* while out < end, enough space available */
+#ifdef INFLATE_STRICT
+    unsigned dmax;              /* maximum distance from zlib header */
+#endif
+    unsigned wsize;             /* window size or zero if not using window */
+    unsigned whave;             /* valid bytes in the window */
+    unsigned wnext;             /* window write index */
+    unsigned char FAR *window;  /* allocated sliding window, if wsize != 0 */
+    unsigned long hold;         /* local strm->hold */
+    unsigned bits;              /* local strm->bits */
+    code const FAR *lcode;      /* local strm->lencode */
+    code const FAR *dcode;      /* local strm->distcode */
+    unsigned lmask;             /* mask for first level of length codes */
+    unsigned dmask;             /* mask for first level of distance codes */
+    code here;                  /* retrieved table entry */
+    unsigned op;                /* code bits, operation, extra bits, or */
+                                /*  window position, window bytes to copy */
+    unsigned len;               /* match length, unused bytes */
+    unsigned dist;              /* match distance */
+    unsigned char FAR *from;    /* where to copy match from */
+
+    /* copy state to local variables */
+    state = (struct inflate_state FAR *)strm->state;
+    in = strm->next_in;
+    last = in + (strm->avail_in - (INFLATE_FAST_MIN_HAVE - 1));
+    out = strm->next_out;
+    beg = out - (start - strm->avail_out);
+    end = out + (strm->avail_out - 257);
+#ifdef INFLATE_STRICT
+    dmax = state->dmax;
+#endif
+    wsize = state->wsize;
+    whave = state->whave;
+    wnext = state->wnext;
+    window = state->window;
+    hold = state->hold;
+    bits = state->bits;
+    lcode = state->lencode;
+    dcode = state->distcode;
+    lmask = (1U << state->lenbits) - 1;
+    dmask = (1U << state->distbits) - 1;
+
+    /* decode literals and length/distances until end-of-block or not enough
+       input data or output space */
+    do {
+        if (bits < 15)
+            REFILL();
+        here = lcode[hold & lmask];
+      dolen:
+        op = (unsigned)(here.bits);
+        hold >>= op;
+        bits -= op;
+        op = (unsigned)(here.op);
+        if (op == 0) {                          /* literal */
+            Tracevv((stderr, here.val >= 0x20 && here.val < 0x7f ?
+                    "inflate:         literal '%c'\n" :
+                    "inflate:         literal 0x%02x\n", here.val));
+            *out++ = (unsigned char)(here.val);
+        }
+        else if (op & 16) {                     /* length base */
+            len = (unsigned)(here.val);
+            op &= 15;                           /* number of extra bits */
+            if (op) {
+                if (bits < op)
+                    REFILL();
+                len += (unsigned)hold & ((1U << op) - 1);
+                hold >>= op;
+                bits -= op;
+            }
+            Tracevv((stderr, "inflate:         length %u\n", len));
+            if (bits < 15)
+                REFILL();
+            here = dcode[hold & dmask];
+          dodist:
+            op = (unsigned)(here.bits);
+            hold >>= op;
+            bits -= op;
+            op = (unsigned)(here.op);
+            if (op & 16) {                      /* distance base */
+                dist = (unsigned)(here.val);
+                op &= 15;                       /* number of extra bits */
+                if (bits < op)
+                    REFILL();
+                dist += (unsigned)hold & ((1U << op) - 1);
+#ifdef INFLATE_STRICT
+                if (dist > dmax) {
+                    strm->msg = (char *)"invalid distance too far back";
+                    state->mode = BAD;
+                    break;
+                }
+#endif
+                hold >>= op;
+                bits -= op;
+                Tracevv((stderr, "inflate:         distance %u\n", dist));
+                op = (unsigned)(out - beg);     /* max distance in output */
+                if (dist > op) {                /* see if copy from window */
+                    op = dist - op;             /* distance back in window */
+                    if (op > whave) {
+                        if (state->sane) {
+                            strm->msg =
+                                (char *)"invalid distance too far back";
+                            state->mode = BAD;
+                            break;
+                        }
+#ifdef INFLATE_ALLOW_INVALID_DISTANCE_TOOFAR_ARRR
+                        if (len <= op - whave) {
+                            do {
+                                *out++ = 0;
+                            } while (--len);
+                            continue;
+                        }
+                        len -= op - whave;
+                        do {
+                            *out++ = 0;
+                        } while (--op > whave);
+                        if (op == 0) {
+                            out = copy_match(out, dist, len);
+                            continue;
+                        }
+#endif
+                    }
+                    from = window;
+                    if (wnext == 0) {           /* very common case */
+                        from += wsize - op;
+                        if (op < len) {         /* some from window */
+                            len -= op;
+                            out = copy_bytes(out, from, op);
+                            out = copy_match(out, dist, len);
+                        }
+                        else
+                            out = copy_bytes(out, from, len);
+                    }
+                    else if (wnext < op) {      /* wrap around window */
+                        from += wsize + wnext - op;
+                        op -= wnext;
+                        if (op < len) {         /* some from end of window */
+                            len -= op;
+                            out = copy_bytes(out, from, op);
+                            if (wnext < len) {  /* some from start of window */
+                                len -= wnext;
+                                out = copy_bytes(out, window, wnext);
+                                out = copy_match(out, dist, len);
+                            }
+                            else
+                                out = copy_bytes(out, window, len);
+                        }
+                        else
+                            out = copy_bytes(out, from, len);
+                    }
+                    else {                      /* contiguous in window */
+                        from += wnext - op;
+                        if (op < len) {         /* some from window */
+                            len -= op;
+                            out = copy_bytes(out, from, op);
+                            out = copy_match(out, dist, len);
+                        }
+                        else
+                            out = copy_bytes(out, from, len);
+                    }
+                }
+                else if (len >= 16 || dist == 1)
+                    out = copy_match(out, dist, len);
+                else {                          /* short, bytewise inline */
+                    from = out - dist;
+                    do {                        /* minimum length is three */
+                        *out++ = *from++;
+                        *out++ = *from++;
+                        *out++ = *from++;
+                        len -= 3;
+                    } while (len > 2);
+                    if (len) {
+                        *out++ = *from++;
+                        if (len > 1)
+                            *out++ = *from++;
+                    }
+                }
+            }
+            else if ((op & 64) == 0) {          /* 2nd level distance code */
+                here = dcode[here.val + (hold & ((1U << op) - 1))];
+                goto dodist;
+            }
+            else {
+                strm->msg = (char *)"invalid distance code";
+                state->mode = BAD;
+                break;
+            }
+        }
+        else if ((op & 64) == 0) {              /* 2nd level length code */
+            here = lcode[here.val + (hold & ((1U << op) - 1))];
+            goto dolen;
+        }
+        else if (op & 32) {                     /* end-of-block */
+            Tracevv((stderr, "inflate:         end of block\n"));
+            state->mode = TYPE;
+            break;
+        }
+        else {
+            strm->msg = (char *)"invalid literal/length code";
+            state->mode = BAD;
+            break;
+        }
+    } while (in < last && out < end);
+
+    /* return unused bytes, and drop the bits loaded ahead of them */
+    len = bits >> 3;
+    in -= len;
+    bits -= len << 3;
+    hold &= (1U << bits) - 1;
+
+    /* update state and return */
+    strm->next_in = in;
+    strm->next_out = out;
+    strm->avail_in = (unsigned)(in < last ?
+                                (INFLATE_FAST_MIN_HAVE - 1) + (last - in) :
+                                (INFLATE_FAST_MIN_HAVE - 1) - (in - last));
+    strm->avail_out = (unsigned)(out < end ?
+                                 257 + (end - out) : 257 - (out - end));
+    state->hold = hold;
+    state->bits = bits;
+    return;
+}
+
+#endif /* INFFAST_WIDE && !ASMINF */
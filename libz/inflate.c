@@ -1004,7 +1004,7 @@ int flush;
         case LEN_:
             state->mode = LEN;
         case LEN:
-            if (have >= 6 && left >= 258) {
+            if (have >= INFLATE_FAST_MIN_HAVE && left >= 258) {
                 RESTORE();
                 inflate_fast(strm, out);
                 LOAD();
@@ -0,0 +1,281 @@
+#include <os.h>
+#include <stdarg.h>
+#include "log.h"
+#include "timer.h"
+#include "profile.h"
+#include "platform.h"
+
+#define LOG_BUFFER_SIZE 16384
+#define LOG_FILE_BATCH 4096 // logged bytes collected before they are written to the file
+#define LOG_SCREEN_INTERVAL 100
+#define LOG_MESSAGE_SIZE 256
+
+// Every message starts with a marker byte holding its level and color, markers
+// are below the printable characters and do not collide with \t, \n and \r
+#define MARKER(level, color) (0x10 + (level) * 4 + (color))
+#define IS_MARKER(c) ((unsigned char)(c) >= MARKER(LOG_QUIET,LOG_PLAIN) && (unsigned char)(c) <= MARKER(LOG_VERBOSE,LOG_FAIL))
+#define MARKER_LEVEL(m) (((m) - 0x10) / 4)
+#define MARKER_COLOR(m) (((m) - 0x10) % 4)
+
+static const int colors[] = {CONSOLE_PLAIN,CONSOLE_GREEN,CONSOLE_YELLOW,CONSOLE_RED};
+
+// Positions count every byte ever logged, the ring holds the last LOG_BUFFER_SIZE of them
+static char ring[LOG_BUFFER_SIZE];
+static unsigned int head;
+static unsigned int file_pos; // written to the file up to here
+static unsigned int screen_pos; // drawn or skipped up to here
+static int screen_marker = MARKER(LOG_NORMAL,LOG_PLAIN); // marker in effect at screen_pos
+static int screen_level = LOG_NORMAL;
+static unsigned int last_draw;
+static FILE* log_file = NULL;
+static char log_path[64];
+
+static unsigned int oldestPosition()
+{
+	return head > LOG_BUFFER_SIZE ? head - LOG_BUFFER_SIZE : 0;
+}
+
+static void writeFile()
+{
+	if(log_file == NULL)
+		return;
+	if(file_pos < oldestPosition())
+		file_pos = oldestPosition();
+	
+	char chunk[256];
+	int len = 0;
+	while(file_pos < head)
+	{
+		char c = ring[file_pos++ % LOG_BUFFER_SIZE];
+		if(IS_MARKER(c))
+			continue;
+		chunk[len++] = c;
+		if(len == sizeof(chunk))
+		{
+			fwrite(chunk,1,len,log_file);
+			len = 0;
+		}
+	}
+	if(len > 0)
+		fwrite(chunk,1,len,log_file);
+}
+
+// Finds the end of the line starting at pos and the lowest level in it,
+// marker is the one in effect at pos and is updated to the one at the end
+static unsigned int scanLine(unsigned int pos, int* marker, int* level)
+{
+	// A line that starts with a new message does not inherit the level of the previous one
+	*level = pos < head && IS_MARKER(ring[pos % LOG_BUFFER_SIZE]) ? LOG_VERBOSE : MARKER_LEVEL(*marker);
+	while(pos < head)
+	{
+		char c = ring[pos++ % LOG_BUFFER_SIZE];
+		if(IS_MARKER(c))
+		{
+			*marker = c;
+			if(MARKER_LEVEL(c) < *level)
+				*level = MARKER_LEVEL(c);
+		}
+		else if(c == '\n')
+			break;
+	}
+	return pos;
+}
+
+static void drawLine(unsigned int pos, unsigned int end, int marker)
+{
+	char text[LOG_MESSAGE_SIZE];
+	int len = 0;
+	consoleColor(colors[MARKER_COLOR(marker)]);
+	while(pos < end)
+	{
+		char c = ring[pos++ % LOG_BUFFER_SIZE];
+		if(IS_MARKER(c) || len == sizeof(text) - 1)
+		{
+			text[len] = '\0';
+			consolePrintf("%s",text);
+			len = 0;
+		}
+		if(IS_MARKER(c))
+			consoleColor(colors[MARKER_COLOR(c)]);
+		else
+			text[len++] = c;
+	}
+	text[len] = '\0';
+	consolePrintf("%s",text);
+	consoleColor(CONSOLE_PLAIN);
+}
+
+// Draws the lines logged since the last call that the screen level lets through,
+// only the last screenful of them since the rest would scroll away anyway.
+// An unfinished line is left for later unless partial is set.
+static void drawScreen(int partial)
+{
+	int phase = profileEnter(PHASE_CONSOLE);
+	if(screen_pos < oldestPosition())
+	{
+		// Lost to the ring, restart at the next whole line
+		int level;
+		screen_marker = MARKER(LOG_NORMAL,LOG_PLAIN);
+		screen_pos = scanLine(oldestPosition(),&screen_marker,&level);
+	}
+	
+	int shown = 0;
+	int marker = screen_marker;
+	unsigned int pos = screen_pos;
+	while(pos < head)
+	{
+		int level;
+		unsigned int end = scanLine(pos,&marker,&level);
+		if(ring[(end - 1) % LOG_BUFFER_SIZE] != '\n' && !partial)
+			break;
+		if(level <= screen_level)
+			shown++;
+		pos = end;
+	}
+	
+	int skip = shown > CONSOLE_ROWS ? shown - CONSOLE_ROWS : 0;
+	while(screen_pos < head)
+	{
+		int level;
+		int end_marker = screen_marker;
+		unsigned int end = scanLine(screen_pos,&end_marker,&level);
+		if(ring[(end - 1) % LOG_BUFFER_SIZE] != '\n' && !partial)
+			break;
+		if(level <= screen_level)
+		{
+			if(skip > 0)
+				skip--;
+			else
+				drawLine(screen_pos,end,screen_marker);
+		}
+		screen_marker = end_marker;
+		screen_pos = end;
+	}
+	profileEnter(phase);
+}
+
+void logSetLevel(int level)
+{
+	screen_level = level;
+}
+
+int logStartFile(const char* file)
+{
+	if(log_file != NULL)
+		fclose(log_file);
+	log_file = fsOpen(file,"wb");
+	if(log_file == NULL)
+		return -1;
+	strncpy(log_path,file,sizeof(log_path) - 1);
+	file_pos = 0;
+	writeFile();
+	return 0;
+}
+
+void logPrint(int level, int color, const char* format, ...)
+{
+	char message[LOG_MESSAGE_SIZE];
+	message[0] = MARKER(level,color);
+	va_list args;
+	va_start(args,format);
+	int len = vsnprintf(message + 1,sizeof(message) - 1,format,args);
+	va_end(args);
+	if(len < 0)
+		return;
+	if(len > (int)sizeof(message) - 2)
+		len = sizeof(message) - 2;
+	len++;
+	
+	// Keep what the file has not got yet from being overwritten
+	if(log_file != NULL && head + len - file_pos > LOG_BUFFER_SIZE)
+		writeFile();
+	
+	int i;
+	for(i = 0; i < len; i++)
+		ring[head++ % LOG_BUFFER_SIZE] = message[i];
+	
+	if(log_file != NULL && head - file_pos >= LOG_FILE_BATCH)
+		writeFile();
+	if(getMilliseconds() - last_draw >= LOG_SCREEN_INTERVAL)
+	{
+		drawScreen(0);
+		last_draw = getMilliseconds();
+	}
+}
+
+void logFlush()
+{
+	drawScreen(1);
+	last_draw = getMilliseconds();
+	writeFile();
+	if(log_file != NULL)
+		fflush(log_file);
+}
+
+void logClose()
+{
+	logFlush();
+	if(log_file != NULL)
+		fclose(log_file);
+	log_file = NULL;
+}
+
+// Waits for a key once the screen is full, returns 0 when ESC was pressed
+static int nextRow(int* rows, int len)
+{
+	*rows += len / CONSOLE_COLS + 1;
+	if(*rows < CONSOLE_ROWS - 1)
+		return 1;
+	consolePrintf("Press any key for more, ESC to stop...");
+	consoleFlush();
+	int more = waitKey();
+	consoleClear();
+	*rows = 0;
+	return more;
+}
+
+void logReplay()
+{
+	logFlush();
+	consoleClear();
+	
+	int rows = 0;
+	if(head > LOG_BUFFER_SIZE && log_file != NULL)
+	{
+		// The start of the log is only left in the file, without colors
+		FILE* f = fsOpen(log_path,"rb");
+		if(f != NULL)
+		{
+			char line[LOG_MESSAGE_SIZE];
+			while(fgets(line,sizeof(line),f) != NULL)
+			{
+				consolePrintf("%s",line);
+				if(strchr(line,'\n') != NULL && !nextRow(&rows,strlen(line)))
+					break;
+			}
+			fclose(f);
+		}
+	}
+	else
+	{
+		int marker = MARKER(LOG_NORMAL,LOG_PLAIN);
+		int level;
+		unsigned int pos = oldestPosition();
+		if(pos > 0)
+			pos = scanLine(pos,&marker,&level);
+		while(pos < head)
+		{
+			int line_marker = marker;
+			unsigned int end = scanLine(pos,&marker,&level);
+			drawLine(pos,end,line_marker);
+			if(!nextRow(&rows,end - pos))
+				break;
+			pos = end;
+		}
+	}
+	
+	consolePrintf("\nPress any key to exit...");
+	consoleFlush();
+	waitKey();
+	screen_pos = head;
+}
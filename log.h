@@ -0,0 +1,31 @@
+#ifndef LOG_H
+#define LOG_H
+
+// Levels of the messages and of what the screen shows, the log file gets everything
+enum
+{
+	LOG_QUIET, // warnings and failures
+	LOG_NORMAL, // steps of an installation
+	LOG_VERBOSE // every file
+};
+
+enum
+{
+	LOG_PLAIN,
+	LOG_SUCCESS,
+	LOG_WARN,
+	LOG_FAIL
+};
+
+// Messages are kept in a ring buffer, appended to the log file in batches and
+// drawn on the default console at most every LOG_SCREEN_INTERVAL ms. A line is
+// shown when any part of it is at or below the screen level.
+void logSetLevel(int screen_level);
+int logStartFile(const char* file); // also writes what was logged before
+void logPrint(int level, int color, const char* format, ...);
+void logFlush(void);
+void logClose(void);
+// Shows the whole log page by page, with every level
+void logReplay(void);
+
+#endif
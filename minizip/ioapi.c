@@ -245,3 +245,352 @@ void fill_fopen64_filefunc (zlib_filefunc64_def*  pzlib_filefunc_def)
     pzlib_filefunc_def->zerror_file = ferror_file_func;
     pzlib_filefunc_def->opaque = NULL;
 }
+
+
+/* state of a zipfile opened with the memory backend, followed by its data */
+typedef struct mem_stream_s
+{
+    uLong size;
+    uLong pos;
+} mem_stream;
+
+static voidpf ZCALLBACK mem_open64_file_func (voidpf opaque, const void* filename, int mode)
+{
+    zlib_mem_def* mem_def = (zlib_mem_def*)opaque;
+    mem_stream* stream;
+    FILE* file;
+    long size;
+
+    if ((filename==NULL) || ((mode & ZLIB_FILEFUNC_MODE_READWRITEFILTER)!=ZLIB_FILEFUNC_MODE_READ))
+        return NULL;
+
+    file = fopen((const char*)filename, "rb");
+    if (file==NULL)
+        return NULL;
+
+    if ((fseek(file, 0, SEEK_END)!=0) || ((size = ftell(file)) < 0) ||
+        ((uLong)size > mem_def->max_size) || (fseek(file, 0, SEEK_SET)!=0))
+    {
+        fclose(file);
+        return NULL;
+    }
+
+    stream = (mem_stream*)malloc(sizeof(mem_stream) + size);
+    if (stream==NULL)
+    {
+        fclose(file);
+        return NULL;
+    }
+
+    if ((size > 0) && (fread(stream + 1, 1, (size_t)size, file)!=(size_t)size))
+    {
+        free(stream);
+        fclose(file);
+        return NULL;
+    }
+    fclose(file);
+
+    stream->size = (uLong)size;
+    stream->pos = 0;
+    mem_def->size = (uLong)size;
+    return stream;
+}
+
+static uLong ZCALLBACK mem_read_file_func (voidpf opaque, voidpf stream, void* buf, uLong size)
+{
+    mem_stream* mem = (mem_stream*)stream;
+    uLong available = mem->size - mem->pos;
+    (void)opaque;
+    if (size > available)
+        size = available;
+    memcpy(buf, (const char*)(mem + 1) + mem->pos, size);
+    mem->pos += size;
+    return size;
+}
+
+static uLong ZCALLBACK mem_write_file_func (voidpf opaque, voidpf stream, const void* buf, uLong size)
+{
+    (void)opaque;
+    (void)stream;
+    (void)buf;
+    (void)size;
+    return 0;
+}
+
+static ZPOS64_T ZCALLBACK mem_tell64_file_func (voidpf opaque, voidpf stream)
+{
+    (void)opaque;
+    return ((mem_stream*)stream)->pos;
+}
+
+static long ZCALLBACK mem_seek64_file_func (voidpf opaque, voidpf stream, ZPOS64_T offset, int origin)
+{
+    mem_stream* mem = (mem_stream*)stream;
+    ZPOS64_T new_pos;
+    (void)opaque;
+    switch (origin)
+    {
+    case ZLIB_FILEFUNC_SEEK_CUR :
+        new_pos = mem->pos + offset;
+        break;
+    case ZLIB_FILEFUNC_SEEK_END :
+        new_pos = mem->size + offset;
+        break;
+    case ZLIB_FILEFUNC_SEEK_SET :
+        new_pos = offset;
+        break;
+    default: return -1;
+    }
+    if (new_pos > mem->size)
+        return -1;
+    mem->pos = (uLong)new_pos;
+    return 0;
+}
+
+static int ZCALLBACK mem_close_file_func (voidpf opaque, voidpf stream)
+{
+    (void)opaque;
+    free(stream);
+    return 0;
+}
+
+static int ZCALLBACK mem_error_file_func (voidpf opaque, voidpf stream)
+{
+    (void)opaque;
+    (void)stream;
+    return 0;
+}
+
+void fill_memory_filefunc64 (zlib_filefunc64_def* pzlib_filefunc_def, zlib_mem_def* pmem_def)
+{
+    pzlib_filefunc_def->zopen64_file = mem_open64_file_func;
+    pzlib_filefunc_def->zread_file = mem_read_file_func;
+    pzlib_filefunc_def->zwrite_file = mem_write_file_func;
+    pzlib_filefunc_def->ztell64_file = mem_tell64_file_func;
+    pzlib_filefunc_def->zseek64_file = mem_seek64_file_func;
+    pzlib_filefunc_def->zclose_file = mem_close_file_func;
+    pzlib_filefunc_def->zerror_file = mem_error_file_func;
+    pzlib_filefunc_def->opaque = pmem_def;
+}
+
+
+/* one cached block of a zipfile opened through the caching layer */
+typedef struct cache_block_s
+{
+    ZPOS64_T offset;            /* offset of the block in the file */
+    uLong length;               /* valid bytes, 0 if the block is unused */
+    uLong last_use;
+    char* data;
+} cache_block;
+
+typedef struct cache_stream_s
+{
+    voidpf base_stream;
+    ZPOS64_T base_pos;          /* position of the underlying stream */
+    ZPOS64_T pos;               /* logical position */
+    ZPOS64_T size;
+    uLong clock;
+    cache_block* blocks;        /* block_count blocks, followed by their data */
+} cache_stream;
+
+static int cache_base_seek (zlib_cache_def* cache_def, cache_stream* stream, ZPOS64_T pos)
+{
+    if (stream->base_pos == pos)
+        return 0;
+    cache_def->base_seeks++;
+    if ((*(cache_def->base.zseek64_file))(cache_def->base.opaque,stream->base_stream,pos,ZLIB_FILEFUNC_SEEK_SET) != 0)
+    {
+        stream->base_pos = (ZPOS64_T)-1;
+        return -1;
+    }
+    stream->base_pos = pos;
+    return 0;
+}
+
+static uLong cache_base_read (zlib_cache_def* cache_def, cache_stream* stream, void* buf, uLong size)
+{
+    uLong read;
+    cache_def->base_reads++;
+    read = (*(cache_def->base.zread_file))(cache_def->base.opaque,stream->base_stream,buf,size);
+    stream->base_pos += read;
+    return read;
+}
+
+static voidpf ZCALLBACK cache_open64_file_func (voidpf opaque, const void* filename, int mode)
+{
+    zlib_cache_def* cache_def = (zlib_cache_def*)opaque;
+    cache_stream* stream;
+    char* data;
+    uLong i;
+
+    if ((cache_def->block_size==0) || (cache_def->block_count==0))
+        return NULL;
+
+    stream = (cache_stream*)malloc(sizeof(cache_stream) +
+                                   cache_def->block_count * (sizeof(cache_block) + cache_def->block_size));
+    if (stream==NULL)
+        return NULL;
+
+    stream->base_stream = (*(cache_def->base.zopen64_file))(cache_def->base.opaque,filename,mode);
+    if (stream->base_stream==NULL)
+    {
+        free(stream);
+        return NULL;
+    }
+
+    stream->blocks = (cache_block*)(stream + 1);
+    data = (char*)(stream->blocks + cache_def->block_count);
+    for (i=0;i<cache_def->block_count;i++)
+    {
+        stream->blocks[i].length = 0;
+        stream->blocks[i].last_use = 0;
+        stream->blocks[i].data = data + i * cache_def->block_size;
+    }
+    stream->clock = 0;
+    stream->pos = 0;
+
+    /* the size is needed to serve ZLIB_FILEFUNC_SEEK_END without a seek */
+    cache_def->base_seeks++;
+    if ((*(cache_def->base.zseek64_file))(cache_def->base.opaque,stream->base_stream,0,ZLIB_FILEFUNC_SEEK_END) != 0)
+    {
+        (*(cache_def->base.zclose_file))(cache_def->base.opaque,stream->base_stream);
+        free(stream);
+        return NULL;
+    }
+    stream->size = (*(cache_def->base.ztell64_file))(cache_def->base.opaque,stream->base_stream);
+    stream->base_pos = stream->size;
+    return stream;
+}
+
+static uLong ZCALLBACK cache_read_file_func (voidpf opaque, voidpf stream, void* buf, uLong size)
+{
+    zlib_cache_def* cache_def = (zlib_cache_def*)opaque;
+    cache_stream* cache = (cache_stream*)stream;
+    uLong done = 0;
+
+    while (done < size)
+    {
+        ZPOS64_T block_offset = cache->pos - (cache->pos % cache_def->block_size);
+        cache_block* block = NULL;
+        cache_block* victim = &cache->blocks[0];
+        uLong offset_in_block;
+        uLong count;
+        uLong i;
+
+        if (cache->pos >= cache->size)
+            break;
+
+        for (i=0;i<cache_def->block_count;i++)
+        {
+            cache_block* candidate = &cache->blocks[i];
+            if ((candidate->length > 0) && (candidate->offset == block_offset))
+            {
+                block = candidate;
+                break;
+            }
+            if (candidate->last_use < victim->last_use)
+                victim = candidate;
+        }
+
+        if (block==NULL)
+        {
+            /* large reads that start on a miss bypass the cache */
+            if (size - done >= cache_def->block_size)
+            {
+                uLong read;
+                if (cache_base_seek(cache_def,cache,cache->pos) != 0)
+                    break;
+                read = cache_base_read(cache_def,cache,(char*)buf + done,size - done);
+                cache->pos += read;
+                done += read;
+                break;
+            }
+
+            if (cache_base_seek(cache_def,cache,block_offset) != 0)
+                break;
+            victim->offset = block_offset;
+            victim->length = cache_base_read(cache_def,cache,victim->data,cache_def->block_size);
+            if (victim->length == 0)
+                break;
+            block = victim;
+        }
+
+        block->last_use = ++cache->clock;
+        offset_in_block = (uLong)(cache->pos - block->offset);
+        if (offset_in_block >= block->length)
+            break;
+        count = block->length - offset_in_block;
+        if (count > size - done)
+            count = size - done;
+        memcpy((char*)buf + done, block->data + offset_in_block, count);
+        cache->pos += count;
+        done += count;
+    }
+    return done;
+}
+
+static uLong ZCALLBACK cache_write_file_func (voidpf opaque, voidpf stream, const void* buf, uLong size)
+{
+    (void)opaque;
+    (void)stream;
+    (void)buf;
+    (void)size;
+    return 0;
+}
+
+static ZPOS64_T ZCALLBACK cache_tell64_file_func (voidpf opaque, voidpf stream)
+{
+    (void)opaque;
+    return ((cache_stream*)stream)->pos;
+}
+
+static long ZCALLBACK cache_seek64_file_func (voidpf opaque, voidpf stream, ZPOS64_T offset, int origin)
+{
+    cache_stream* cache = (cache_stream*)stream;
+    ZPOS64_T new_pos;
+    (void)opaque;
+    switch (origin)
+    {
+    case ZLIB_FILEFUNC_SEEK_CUR :
+        new_pos = cache->pos + offset;
+        break;
+    case ZLIB_FILEFUNC_SEEK_END :
+        new_pos = cache->size + offset;
+        break;
+    case ZLIB_FILEFUNC_SEEK_SET :
+        new_pos = offset;
+        break;
+    default: return -1;
+    }
+    if (new_pos > cache->size)
+        return -1;
+    cache->pos = new_pos;
+    return 0;
+}
+
+static int ZCALLBACK cache_close_file_func (voidpf opaque, voidpf stream)
+{
+    zlib_cache_def* cache_def = (zlib_cache_def*)opaque;
+    cache_stream* cache = (cache_stream*)stream;
+    int ret = (*(cache_def->base.zclose_file))(cache_def->base.opaque,cache->base_stream);
+    free(cache);
+    return ret;
+}
+
+static int ZCALLBACK cache_error_file_func (voidpf opaque, voidpf stream)
+{
+    zlib_cache_def* cache_def = (zlib_cache_def*)opaque;
+    return (*(cache_def->base.zerror_file))(cache_def->base.opaque,((cache_stream*)stream)->base_stream);
+}
+
+void fill_cached_filefunc64 (zlib_filefunc64_def* pzlib_filefunc_def, zlib_cache_def* pcache_def)
+{
+    pzlib_filefunc_def->zopen64_file = cache_open64_file_func;
+    pzlib_filefunc_def->zread_file = cache_read_file_func;
+    pzlib_filefunc_def->zwrite_file = cache_write_file_func;
+    pzlib_filefunc_def->ztell64_file = cache_tell64_file_func;
+    pzlib_filefunc_def->zseek64_file = cache_seek64_file_func;
+    pzlib_filefunc_def->zclose_file = cache_close_file_func;
+    pzlib_filefunc_def->zerror_file = cache_error_file_func;
+    pzlib_filefunc_def->opaque = pcache_def;
+}
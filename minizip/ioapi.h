@@ -176,6 +176,37 @@ typedef struct zlib_filefunc64_def_s
 void fill_fopen64_filefunc OF((zlib_filefunc64_def* pzlib_filefunc_def));
 void fill_fopen_filefunc OF((zlib_filefunc_def* pzlib_filefunc_def));
 
+/* Memory backend: open reads the whole file into one buffer and every later
+   read or seek is served from RAM. Files larger than max_size are not
+   loaded, open then fails and the caller can fall back to fill_fopen64_filefunc.
+   The zlib_mem_def is only used by open, it must stay valid until the
+   zipfile is opened. Only reading is supported. */
+typedef struct zlib_mem_def_s
+{
+    uLong max_size;             /* largest file that will be loaded */
+    uLong size;                 /* size of the file loaded by the last open */
+} zlib_mem_def;
+
+void fill_memory_filefunc64 OF((zlib_filefunc64_def* pzlib_filefunc_def, zlib_mem_def* pmem_def));
+
+/* Caching layer on top of any zlib_filefunc64_def: seeks only move a
+   logical position, reads are served from block_count blocks of block_size
+   bytes (least recently used is replaced), and the underlying stream is only
+   seeked when a block is loaded from somewhere else than its current
+   position. Reads of at least block_size bytes that miss the cache go
+   straight to the caller's buffer. The zlib_cache_def must stay valid until
+   the zipfile is closed, it also collects the number of underlying calls. */
+typedef struct zlib_cache_def_s
+{
+    zlib_filefunc64_def base;   /* functions of the underlying stream */
+    uLong block_size;
+    uLong block_count;
+    uLong base_reads;           /* number of reads on the underlying stream */
+    uLong base_seeks;           /* number of seeks on the underlying stream */
+} zlib_cache_def;
+
+void fill_cached_filefunc64 OF((zlib_filefunc64_def* pzlib_filefunc_def, zlib_cache_def* pcache_def));
+
 /* now internal definition, only for zip.c and unzip.h */
 typedef struct zlib_filefunc64_32_def_s
 {
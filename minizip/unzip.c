@@ -104,11 +104,34 @@
 #define UNZ_MAXFILENAMEINZIP (256)
 #endif
 
+/* allocator for the zipfile structures, the buffers and the inflate
+   streams, see unzSetAllocFunctions */
+local alloc_func unz_zalloc = (alloc_func)0;
+local free_func unz_zfree = (free_func)0;
+local voidpf unz_alloc_opaque = (voidpf)0;
+
+local voidpf unz64local_Alloc OF((uLong size));
+local voidpf unz64local_Alloc (uLong size)
+{
+    if (unz_zalloc != (alloc_func)0)
+        return (*unz_zalloc)(unz_alloc_opaque,1,(uInt)size);
+    return malloc(size);
+}
+
+local void unz64local_Free OF((voidpf address));
+local void unz64local_Free (voidpf address)
+{
+    if (unz_zfree != (free_func)0)
+        (*unz_zfree)(unz_alloc_opaque,address);
+    else
+        free(address);
+}
+
 #ifndef ALLOC
-# define ALLOC(size) (malloc(size))
+# define ALLOC(size) (unz64local_Alloc(size))
 #endif
 #ifndef TRYFREE
-# define TRYFREE(p) {if (p) free(p);}
+# define TRYFREE(p) {if (p) unz64local_Free(p);}
 #endif
 
 #define SIZECENTRALDIRITEM (0x2e)
@@ -130,6 +153,7 @@ typedef struct unz_file_info64_internal_s
 typedef struct
 {
     char  *read_buffer;         /* internal buffer for compressed data */
+    uInt  read_buffer_size;     /* size of read_buffer */
     z_stream stream;            /* zLib stream structure for inflate */
 
 #ifdef HAVE_BZIP2
@@ -138,6 +162,7 @@ typedef struct
 
     ZPOS64_T pos_in_zipfile;       /* position in byte on the zipfile, for fseek*/
     uLong stream_initialised;   /* flag set if stream structure is initialised*/
+    int   inflate_ready;        /* flag set if stream holds an inflate state */
 
     ZPOS64_T offset_local_extrafield;/* offset of the local extra field */
     uInt  size_local_extrafield;/* size of the local extra field */
@@ -145,6 +170,7 @@ typedef struct
     ZPOS64_T total_out_64;
 
     uLong crc32;                /* crc32 of all data uncompressed */
+    int   check_crc;            /* flag set if crc32 is computed and checked */
     uLong crc32_wait;           /* crc32 we must obtain after decompress all */
     ZPOS64_T rest_read_compressed; /* number of byte to be decompressed */
     ZPOS64_T rest_read_uncompressed;/*number of byte to be obtained after decomp*/
@@ -156,6 +182,31 @@ typedef struct
 } file_in_zip64_read_info_s;
 
 
+#ifndef UNZ_NOLOCATEINDEX
+#define UNZ_LOCATE_NONE ((uLong)-1)
+
+/* one central directory entry in the filename index used by unzLocateFile */
+typedef struct unz64_locate_entry_s
+{
+    uLong hash_cs;              /* hash of the filename */
+    uLong hash_ci;              /* hash of the filename with a-z folded to A-Z */
+    ZPOS64_T pos_in_central_dir;/* position of the entry in the central dir */
+    uLong next_cs;              /* next entry in the same case sensitive bucket */
+    uLong next_ci;              /* next entry in the same case insensitive bucket */
+} unz64_locate_entry;
+
+/* unz64_locate_index maps filenames to central directory positions so that
+   unzLocateFile does not have to decode every header before the one it wants
+*/
+typedef struct unz64_locate_index_s
+{
+    uLong bucket_mask;          /* number of buckets - 1, a power of two */
+    uLong* buckets_cs;
+    uLong* buckets_ci;
+    unz64_locate_entry* entries;
+} unz64_locate_index;
+#endif
+
 /* unz64_s contain internal information about the zipfile
 */
 typedef struct
@@ -182,6 +233,17 @@ typedef struct
 
     int isZip64;
 
+    uInt read_buffer_size;      /* size of the compressed data buffer */
+    int reuse_read_info;        /* keep the read info of closed files */
+    int check_crc;              /* compute and check the crc of files */
+    file_in_zip64_read_info_s* pfile_in_zip_read_spare; /* kept read info,
+                                        with its buffer and inflate state */
+
+#ifndef UNZ_NOLOCATEINDEX
+    unz64_locate_index* locate_index; /* filename index, built on first lookup */
+    int locate_index_failed;    /* flag set if the index could not be built */
+#endif
+
 #    ifndef NOUNCRYPT
     unsigned long keys[3];     /* keys defining the pseudo-random sequence */
     const z_crc_t* pcrc_32_tab;
@@ -193,6 +255,15 @@ typedef struct
 #include "crypt.h"
 #endif
 
+local void unz64local_FreeReadInfo OF((file_in_zip64_read_info_s* pfile_in_zip_read_info));
+local void unz64local_FreeReadInfo (file_in_zip64_read_info_s* pfile_in_zip_read_info)
+{
+    if (pfile_in_zip_read_info->inflate_ready)
+        inflateEnd(&pfile_in_zip_read_info->stream);
+    TRYFREE(pfile_in_zip_read_info->read_buffer);
+    TRYFREE(pfile_in_zip_read_info);
+}
+
 /* ===========================================================================
      Read a byte from a gz_stream; update next_in and avail_in. Return EOF
    for end of file.
@@ -746,6 +817,14 @@ local unzFile unzOpenInternal (const void *path,
     us.central_pos = central_pos;
     us.pfile_in_zip_read = NULL;
     us.encrypted = 0;
+    us.read_buffer_size = UNZ_BUFSIZE;
+    us.reuse_read_info = 0;
+    us.pfile_in_zip_read_spare = NULL;
+    us.check_crc = 1;
+#ifndef UNZ_NOLOCATEINDEX
+    us.locate_index = NULL;
+    us.locate_index_failed = 0;
+#endif
 
 
     s=(unz64_s*)ALLOC(sizeof(unz64_s));
@@ -811,12 +890,73 @@ extern int ZEXPORT unzClose (unzFile file)
     if (s->pfile_in_zip_read!=NULL)
         unzCloseCurrentFile(file);
 
+    if (s->pfile_in_zip_read_spare!=NULL)
+        unz64local_FreeReadInfo(s->pfile_in_zip_read_spare);
+
+#ifndef UNZ_NOLOCATEINDEX
+    TRYFREE(s->locate_index);
+#endif
+
     ZCLOSE64(s->z_filefunc, s->filestream);
     TRYFREE(s);
     return UNZ_OK;
 }
 
 
+extern void ZEXPORT unzSetAllocFunctions (alloc_func zalloc, free_func zfree, voidpf opaque)
+{
+    unz_zalloc = zalloc;
+    unz_zfree = zfree;
+    unz_alloc_opaque = opaque;
+}
+
+/*
+  Set the size of the buffer used to read compressed data of the files opened
+  afterwards with unzOpenCurrentFile.
+*/
+extern int ZEXPORT unzSetReadBufferSize (unzFile file, uInt size)
+{
+    unz64_s* s;
+    if ((file==NULL) || (size==0))
+        return UNZ_PARAMERROR;
+    s=(unz64_s*)file;
+    s->read_buffer_size = size;
+    return UNZ_OK;
+}
+
+/*
+  Keep the read information, buffer and inflate stream of closed files for
+  the next file opened with unzOpenCurrentFile.
+*/
+extern int ZEXPORT unzSetStreamReuse (unzFile file, int reuse)
+{
+    unz64_s* s;
+    if (file==NULL)
+        return UNZ_PARAMERROR;
+    s=(unz64_s*)file;
+    s->reuse_read_info = reuse;
+    if ((!reuse) && (s->pfile_in_zip_read_spare!=NULL))
+    {
+        unz64local_FreeReadInfo(s->pfile_in_zip_read_spare);
+        s->pfile_in_zip_read_spare = NULL;
+    }
+    return UNZ_OK;
+}
+
+/*
+  Turn the crc computation of unzReadCurrentFile and the check in
+  unzCloseCurrentFile on or off for the files opened afterwards.
+*/
+extern int ZEXPORT unzSetCrcCheck (unzFile file, int check)
+{
+    unz64_s* s;
+    if (file==NULL)
+        return UNZ_PARAMERROR;
+    s=(unz64_s*)file;
+    s->check_crc = check;
+    return UNZ_OK;
+}
+
 /*
   Write info about the ZipFile in the *pglobal_info structure.
   No preparation of the structure is needed
@@ -1217,10 +1357,178 @@ extern int ZEXPORT unzGoToNextFile (unzFile  file)
 }
 
 
+#ifndef UNZ_NOLOCATEINDEX
+/*
+  FNV-1a hash of a filename. If iFoldCase is set, a-z are hashed as A-Z,
+    matching strcmpcasenosensitive_internal.
+*/
+local uLong unz64local_HashFileName (const char* fileName, int iFoldCase)
+{
+    uLong hash = 2166136261UL;
+    for (;;)
+    {
+        char c = *(fileName++);
+        if (c=='\0')
+            break;
+        if ((iFoldCase) && (c>='a') && (c<='z'))
+            c -= 0x20;
+        hash = ((hash ^ (unsigned char)c) * 16777619UL) & 0xffffffffUL;
+    }
+    return hash;
+}
+
+/*
+  Walk the central directory once and build the filename index.
+  The current file is left unchanged.
+  return UNZ_OK if the index could be built
+*/
+local int unz64local_BuildLocateIndex (unz64_s* s)
+{
+    unz64_locate_index* index;
+    uLong number_entry;
+    uLong bucket_count;
+    uLong i;
+    int err;
+
+    unz_file_info64 cur_file_infoSaved;
+    unz_file_info64_internal cur_file_info_internalSaved;
+    ZPOS64_T num_fileSaved;
+    ZPOS64_T pos_in_central_dirSaved;
+    ZPOS64_T current_file_okSaved;
+
+    /* 2^16 files overflow hack: the real count is unknown, use a linear scan */
+    if ((s->gi.number_entry == 0) || (s->gi.number_entry >= 0xffff))
+        return UNZ_PARAMERROR;
+    number_entry = (uLong)s->gi.number_entry;
+
+    bucket_count = 1;
+    while (bucket_count < number_entry)
+        bucket_count <<= 1;
+
+    index = (unz64_locate_index*)ALLOC(sizeof(unz64_locate_index) +
+                                       2 * bucket_count * sizeof(uLong) +
+                                       number_entry * sizeof(unz64_locate_entry));
+    if (index==NULL)
+        return UNZ_INTERNALERROR;
+
+    index->bucket_mask = bucket_count - 1;
+    index->entries = (unz64_locate_entry*)(index + 1);
+    index->buckets_cs = (uLong*)(index->entries + number_entry);
+    index->buckets_ci = index->buckets_cs + bucket_count;
+    for (i=0;i<bucket_count;i++)
+    {
+        index->buckets_cs[i] = UNZ_LOCATE_NONE;
+        index->buckets_ci[i] = UNZ_LOCATE_NONE;
+    }
+
+    num_fileSaved = s->num_file;
+    pos_in_central_dirSaved = s->pos_in_central_dir;
+    cur_file_infoSaved = s->cur_file_info;
+    cur_file_info_internalSaved = s->cur_file_info_internal;
+    current_file_okSaved = s->current_file_ok;
+
+    err = unzGoToFirstFile((unzFile)s);
+    for (i=0; (err==UNZ_OK) && (i<number_entry); i++)
+    {
+        char szCurrentFileName[UNZ_MAXFILENAMEINZIP+1];
+        err = unzGetCurrentFileInfo64((unzFile)s,NULL,
+                                    szCurrentFileName,sizeof(szCurrentFileName)-1,
+                                    NULL,0,NULL,0);
+        if (err == UNZ_OK)
+        {
+            index->entries[i].hash_cs = unz64local_HashFileName(szCurrentFileName,0);
+            index->entries[i].hash_ci = unz64local_HashFileName(szCurrentFileName,1);
+            index->entries[i].pos_in_central_dir = s->pos_in_central_dir;
+            err = unzGoToNextFile((unzFile)s);
+        }
+    }
+    if (err==UNZ_END_OF_LIST_OF_FILE)
+        err = UNZ_OK;
+    if ((err==UNZ_OK) && (i!=number_entry))
+        err = UNZ_BADZIPFILE;
+
+    s->num_file = num_fileSaved;
+    s->pos_in_central_dir = pos_in_central_dirSaved;
+    s->cur_file_info = cur_file_infoSaved;
+    s->cur_file_info_internal = cur_file_info_internalSaved;
+    s->current_file_ok = current_file_okSaved;
+
+    if (err!=UNZ_OK)
+    {
+        TRYFREE(index);
+        return err;
+    }
+
+    /* chain from the last entry to the first one, so that lookups find the
+       first matching entry first, like the linear scan does */
+    for (i=number_entry; i-->0;)
+    {
+        uLong bucket_cs = index->entries[i].hash_cs & index->bucket_mask;
+        uLong bucket_ci = index->entries[i].hash_ci & index->bucket_mask;
+        index->entries[i].next_cs = index->buckets_cs[bucket_cs];
+        index->buckets_cs[bucket_cs] = i;
+        index->entries[i].next_ci = index->buckets_ci[bucket_ci];
+        index->buckets_ci[bucket_ci] = i;
+    }
+
+    s->locate_index = index;
+    return UNZ_OK;
+}
+
+/*
+  Look szFileName up in the filename index. Candidates whose hash matches
+    are confirmed by decoding their header and comparing the name.
+  return UNZ_OK if the file is found. It becomes the current file.
+  return UNZ_END_OF_LIST_OF_FILE if the file is not found, the current
+    file is then undefined.
+*/
+local int unz64local_LocateFileIndexed (unz64_s* s, const char *szFileName, int iCaseSensitivity)
+{
+    unz64_locate_index* index = s->locate_index;
+    int iFoldCase = (iCaseSensitivity!=1);
+    uLong hash = unz64local_HashFileName(szFileName,iFoldCase);
+    uLong i;
+
+    if (iFoldCase)
+        i = index->buckets_ci[hash & index->bucket_mask];
+    else
+        i = index->buckets_cs[hash & index->bucket_mask];
+
+    while (i!=UNZ_LOCATE_NONE)
+    {
+        unz64_locate_entry* entry = &index->entries[i];
+        if ((iFoldCase ? entry->hash_ci : entry->hash_cs) == hash)
+        {
+            char szCurrentFileName[UNZ_MAXFILENAMEINZIP+1];
+            int err;
+
+            s->pos_in_central_dir = entry->pos_in_central_dir;
+            s->num_file = i;
+            err = unz64local_GetCurrentFileInfoInternal((unzFile)s,&s->cur_file_info,
+                                                       &s->cur_file_info_internal,
+                                                       szCurrentFileName,sizeof(szCurrentFileName)-1,
+                                                       NULL,0,NULL,0);
+            if (err!=UNZ_OK)
+                return err;
+            if (unzStringFileNameCompare(szCurrentFileName,
+                                            szFileName,iCaseSensitivity)==0)
+                return UNZ_OK;
+        }
+        i = iFoldCase ? entry->next_ci : entry->next_cs;
+    }
+    return UNZ_END_OF_LIST_OF_FILE;
+}
+#endif
+
 /*
   Try locate the file szFileName in the zipfile.
   For the iCaseSensitivity signification, see unzStringFileNameCompare
 
+  The first lookup builds a hash index of the central directory (unless
+    compiled with UNZ_NOLOCATEINDEX), so later lookups do not depend on
+    the number of entries. If the index cannot be built, the central
+    directory is scanned linearly.
+
   return value :
   UNZ_OK if the file is found. It becomes the current file.
   UNZ_END_OF_LIST_OF_FILE if the file is not found
@@ -1249,26 +1557,46 @@ extern int ZEXPORT unzLocateFile (unzFile file, const char *szFileName, int iCas
     if (!s->current_file_ok)
         return UNZ_END_OF_LIST_OF_FILE;
 
+    if (iCaseSensitivity==0)
+        iCaseSensitivity=CASESENSITIVITYDEFAULTVALUE;
+
     /* Save the current state */
     num_fileSaved = s->num_file;
     pos_in_central_dirSaved = s->pos_in_central_dir;
     cur_file_infoSaved = s->cur_file_info;
     cur_file_info_internalSaved = s->cur_file_info_internal;
 
-    err = unzGoToFirstFile(file);
+#ifndef UNZ_NOLOCATEINDEX
+    if ((s->locate_index==NULL) && (!s->locate_index_failed))
+        s->locate_index_failed = (unz64local_BuildLocateIndex(s)!=UNZ_OK);
 
-    while (err == UNZ_OK)
+    if (s->locate_index!=NULL)
     {
-        char szCurrentFileName[UNZ_MAXFILENAMEINZIP+1];
-        err = unzGetCurrentFileInfo64(file,NULL,
-                                    szCurrentFileName,sizeof(szCurrentFileName)-1,
-                                    NULL,0,NULL,0);
+        err = unz64local_LocateFileIndexed(s,szFileName,iCaseSensitivity);
         if (err == UNZ_OK)
         {
-            if (unzStringFileNameCompare(szCurrentFileName,
-                                            szFileName,iCaseSensitivity)==0)
-                return UNZ_OK;
-            err = unzGoToNextFile(file);
+            s->current_file_ok = 1;
+            return UNZ_OK;
+        }
+    }
+    else
+#endif
+    {
+        err = unzGoToFirstFile(file);
+
+        while (err == UNZ_OK)
+        {
+            char szCurrentFileName[UNZ_MAXFILENAMEINZIP+1];
+            err = unzGetCurrentFileInfo64(file,NULL,
+                                        szCurrentFileName,sizeof(szCurrentFileName)-1,
+                                        NULL,0,NULL,0);
+            if (err == UNZ_OK)
+            {
+                if (unzStringFileNameCompare(szCurrentFileName,
+                                                szFileName,iCaseSensitivity)==0)
+                    return UNZ_OK;
+                err = unzGoToNextFile(file);
+            }
         }
     }
 
@@ -1279,6 +1607,7 @@ extern int ZEXPORT unzLocateFile (unzFile file, const char *szFileName, int iCas
     s->pos_in_central_dir = pos_in_central_dirSaved ;
     s->cur_file_info = cur_file_infoSaved;
     s->cur_file_info_internal = cur_file_info_internalSaved;
+    s->current_file_ok = 1;
     return err;
 }
 
@@ -1493,22 +1822,36 @@ extern int ZEXPORT unzOpenCurrentFile3 (unzFile file, int* method,
     if (unz64local_CheckCurrentFileCoherencyHeader(s,&iSizeVar, &offset_local_extrafield,&size_local_extrafield)!=UNZ_OK)
         return UNZ_BADZIPFILE;
 
-    pfile_in_zip_read_info = (file_in_zip64_read_info_s*)ALLOC(sizeof(file_in_zip64_read_info_s));
+    pfile_in_zip_read_info = s->pfile_in_zip_read_spare;
+    s->pfile_in_zip_read_spare = NULL;
+    if ((pfile_in_zip_read_info!=NULL) &&
+        (pfile_in_zip_read_info->read_buffer_size!=s->read_buffer_size))
+    {
+        unz64local_FreeReadInfo(pfile_in_zip_read_info);
+        pfile_in_zip_read_info = NULL;
+    }
+
     if (pfile_in_zip_read_info==NULL)
-        return UNZ_INTERNALERROR;
+    {
+        pfile_in_zip_read_info = (file_in_zip64_read_info_s*)ALLOC(sizeof(file_in_zip64_read_info_s));
+        if (pfile_in_zip_read_info==NULL)
+            return UNZ_INTERNALERROR;
+
+        pfile_in_zip_read_info->inflate_ready=0;
+        pfile_in_zip_read_info->read_buffer_size=s->read_buffer_size;
+        pfile_in_zip_read_info->read_buffer=(char*)ALLOC(s->read_buffer_size);
+        if (pfile_in_zip_read_info->read_buffer==NULL)
+        {
+            TRYFREE(pfile_in_zip_read_info);
+            return UNZ_INTERNALERROR;
+        }
+    }
 
-    pfile_in_zip_read_info->read_buffer=(char*)ALLOC(UNZ_BUFSIZE);
     pfile_in_zip_read_info->offset_local_extrafield = offset_local_extrafield;
     pfile_in_zip_read_info->size_local_extrafield = size_local_extrafield;
     pfile_in_zip_read_info->pos_local_extrafield=0;
     pfile_in_zip_read_info->raw=raw;
 
-    if (pfile_in_zip_read_info->read_buffer==NULL)
-    {
-        TRYFREE(pfile_in_zip_read_info);
-        return UNZ_INTERNALERROR;
-    }
-
     pfile_in_zip_read_info->stream_initialised=0;
 
     if (method!=NULL)
@@ -1535,6 +1878,7 @@ extern int ZEXPORT unzOpenCurrentFile3 (unzFile file, int* method,
 
     pfile_in_zip_read_info->crc32_wait=s->cur_file_info.crc;
     pfile_in_zip_read_info->crc32=0;
+    pfile_in_zip_read_info->check_crc=s->check_crc;
     pfile_in_zip_read_info->total_out_64=0;
     pfile_in_zip_read_info->compression_method = s->cur_file_info.compression_method;
     pfile_in_zip_read_info->filestream=s->filestream;
@@ -1571,18 +1915,24 @@ extern int ZEXPORT unzOpenCurrentFile3 (unzFile file, int* method,
     }
     else if ((s->cur_file_info.compression_method==Z_DEFLATED) && (!raw))
     {
-      pfile_in_zip_read_info->stream.zalloc = (alloc_func)0;
-      pfile_in_zip_read_info->stream.zfree = (free_func)0;
-      pfile_in_zip_read_info->stream.opaque = (voidpf)0;
       pfile_in_zip_read_info->stream.next_in = 0;
       pfile_in_zip_read_info->stream.avail_in = 0;
 
-      err=inflateInit2(&pfile_in_zip_read_info->stream, -MAX_WBITS);
+      if (pfile_in_zip_read_info->inflate_ready)
+        err=inflateReset(&pfile_in_zip_read_info->stream);
+      else
+      {
+        pfile_in_zip_read_info->stream.zalloc = unz_zalloc;
+        pfile_in_zip_read_info->stream.zfree = unz_zfree;
+        pfile_in_zip_read_info->stream.opaque = unz_alloc_opaque;
+        err=inflateInit2(&pfile_in_zip_read_info->stream, -MAX_WBITS);
+        pfile_in_zip_read_info->inflate_ready = (err == Z_OK);
+      }
       if (err == Z_OK)
         pfile_in_zip_read_info->stream_initialised=Z_DEFLATED;
       else
       {
-        TRYFREE(pfile_in_zip_read_info);
+        unz64local_FreeReadInfo(pfile_in_zip_read_info);
         return err;
       }
         /* windowBits is passed < 0 to tell that there is no zlib header.
@@ -1715,10 +2065,51 @@ extern int ZEXPORT unzReadCurrentFile  (unzFile file, voidp buf, unsigned len)
 
     while (pfile_in_zip_read_info->stream.avail_out>0)
     {
+        if ((pfile_in_zip_read_info->compression_method==0) &&
+            (!pfile_in_zip_read_info->raw) &&
+#            ifndef NOUNCRYPT
+            (!s->encrypted) &&
+#            endif
+            (pfile_in_zip_read_info->stream.avail_in==0) &&
+            (pfile_in_zip_read_info->rest_read_compressed>0) &&
+            (pfile_in_zip_read_info->stream.avail_out>=pfile_in_zip_read_info->read_buffer_size))
+        {
+            /* stored data needs no staging, read it straight into the
+               caller's buffer and compute the crc in the same pass */
+            uInt uReadThis = pfile_in_zip_read_info->stream.avail_out;
+            if (pfile_in_zip_read_info->rest_read_compressed<uReadThis)
+                uReadThis = (uInt)pfile_in_zip_read_info->rest_read_compressed;
+            if (ZSEEK64(pfile_in_zip_read_info->z_filefunc,
+                      pfile_in_zip_read_info->filestream,
+                      pfile_in_zip_read_info->pos_in_zipfile +
+                         pfile_in_zip_read_info->byte_before_the_zipfile,
+                         ZLIB_FILEFUNC_SEEK_SET)!=0)
+                return UNZ_ERRNO;
+            if (ZREAD64(pfile_in_zip_read_info->z_filefunc,
+                      pfile_in_zip_read_info->filestream,
+                      pfile_in_zip_read_info->stream.next_out,
+                      uReadThis)!=uReadThis)
+                return UNZ_ERRNO;
+
+            if (pfile_in_zip_read_info->check_crc)
+                pfile_in_zip_read_info->crc32 = crc32(pfile_in_zip_read_info->crc32,
+                                    pfile_in_zip_read_info->stream.next_out,
+                                    uReadThis);
+            pfile_in_zip_read_info->pos_in_zipfile += uReadThis;
+            pfile_in_zip_read_info->rest_read_compressed -= uReadThis;
+            pfile_in_zip_read_info->rest_read_uncompressed -= uReadThis;
+            pfile_in_zip_read_info->total_out_64 += uReadThis;
+            pfile_in_zip_read_info->stream.avail_out -= uReadThis;
+            pfile_in_zip_read_info->stream.next_out += uReadThis;
+            pfile_in_zip_read_info->stream.total_out += uReadThis;
+            iRead += uReadThis;
+            continue;
+        }
+
         if ((pfile_in_zip_read_info->stream.avail_in==0) &&
             (pfile_in_zip_read_info->rest_read_compressed>0))
         {
-            uInt uReadThis = UNZ_BUFSIZE;
+            uInt uReadThis = pfile_in_zip_read_info->read_buffer_size;
             if (pfile_in_zip_read_info->rest_read_compressed<uReadThis)
                 uReadThis = (uInt)pfile_in_zip_read_info->rest_read_compressed;
             if (uReadThis == 0)
@@ -1759,7 +2150,7 @@ extern int ZEXPORT unzReadCurrentFile  (unzFile file, voidp buf, unsigned len)
 
         if ((pfile_in_zip_read_info->compression_method==0) || (pfile_in_zip_read_info->raw))
         {
-            uInt uDoCopy,i ;
+            uInt uDoCopy;
 
             if ((pfile_in_zip_read_info->stream.avail_in == 0) &&
                 (pfile_in_zip_read_info->rest_read_compressed == 0))
@@ -1771,15 +2162,15 @@ extern int ZEXPORT unzReadCurrentFile  (unzFile file, voidp buf, unsigned len)
             else
                 uDoCopy = pfile_in_zip_read_info->stream.avail_in ;
 
-            for (i=0;i<uDoCopy;i++)
-                *(pfile_in_zip_read_info->stream.next_out+i) =
-                        *(pfile_in_zip_read_info->stream.next_in+i);
+            memcpy(pfile_in_zip_read_info->stream.next_out,
+                   pfile_in_zip_read_info->stream.next_in,uDoCopy);
 
             pfile_in_zip_read_info->total_out_64 = pfile_in_zip_read_info->total_out_64 + uDoCopy;
 
-            pfile_in_zip_read_info->crc32 = crc32(pfile_in_zip_read_info->crc32,
-                                pfile_in_zip_read_info->stream.next_out,
-                                uDoCopy);
+            if (pfile_in_zip_read_info->check_crc)
+                pfile_in_zip_read_info->crc32 = crc32(pfile_in_zip_read_info->crc32,
+                                    pfile_in_zip_read_info->stream.next_out,
+                                    uDoCopy);
             pfile_in_zip_read_info->rest_read_uncompressed-=uDoCopy;
             pfile_in_zip_read_info->stream.avail_in -= uDoCopy;
             pfile_in_zip_read_info->stream.avail_out -= uDoCopy;
@@ -1814,7 +2205,8 @@ extern int ZEXPORT unzReadCurrentFile  (unzFile file, voidp buf, unsigned len)
 
             pfile_in_zip_read_info->total_out_64 = pfile_in_zip_read_info->total_out_64 + uOutThis;
 
-            pfile_in_zip_read_info->crc32 = crc32(pfile_in_zip_read_info->crc32,bufBefore, (uInt)(uOutThis));
+            if (pfile_in_zip_read_info->check_crc)
+                pfile_in_zip_read_info->crc32 = crc32(pfile_in_zip_read_info->crc32,bufBefore, (uInt)(uOutThis));
             pfile_in_zip_read_info->rest_read_uncompressed -= uOutThis;
             iRead += (uInt)(uTotalOutAfter - uTotalOutBefore);
 
@@ -1857,9 +2249,10 @@ extern int ZEXPORT unzReadCurrentFile  (unzFile file, voidp buf, unsigned len)
 
             pfile_in_zip_read_info->total_out_64 = pfile_in_zip_read_info->total_out_64 + uOutThis;
 
-            pfile_in_zip_read_info->crc32 =
-                crc32(pfile_in_zip_read_info->crc32,bufBefore,
-                        (uInt)(uOutThis));
+            if (pfile_in_zip_read_info->check_crc)
+                pfile_in_zip_read_info->crc32 =
+                    crc32(pfile_in_zip_read_info->crc32,bufBefore,
+                            (uInt)(uOutThis));
 
             pfile_in_zip_read_info->rest_read_uncompressed -=
                 uOutThis;
@@ -2013,25 +2406,27 @@ extern int ZEXPORT unzCloseCurrentFile (unzFile file)
 
 
     if ((pfile_in_zip_read_info->rest_read_uncompressed == 0) &&
-        (!pfile_in_zip_read_info->raw))
+        (!pfile_in_zip_read_info->raw) &&
+        (pfile_in_zip_read_info->check_crc))
     {
         if (pfile_in_zip_read_info->crc32 != pfile_in_zip_read_info->crc32_wait)
             err=UNZ_CRCERROR;
     }
 
 
-    TRYFREE(pfile_in_zip_read_info->read_buffer);
-    pfile_in_zip_read_info->read_buffer = NULL;
-    if (pfile_in_zip_read_info->stream_initialised == Z_DEFLATED)
-        inflateEnd(&pfile_in_zip_read_info->stream);
 #ifdef HAVE_BZIP2
-    else if (pfile_in_zip_read_info->stream_initialised == Z_BZIP2ED)
+    if (pfile_in_zip_read_info->stream_initialised == Z_BZIP2ED)
         BZ2_bzDecompressEnd(&pfile_in_zip_read_info->bstream);
 #endif
 
 
     pfile_in_zip_read_info->stream_initialised = 0;
-    TRYFREE(pfile_in_zip_read_info);
+    /* the inflate state is ended together with the read info, which may be
+       kept for the next file */
+    if (s->reuse_read_info)
+        s->pfile_in_zip_read_spare = pfile_in_zip_read_info;
+    else
+        unz64local_FreeReadInfo(pfile_in_zip_read_info);
 
     s->pfile_in_zip_read=NULL;
 
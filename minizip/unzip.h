@@ -202,6 +202,37 @@ extern int ZEXPORT unzClose OF((unzFile file));
     these files MUST be closed with unzCloseCurrentFile before call unzClose.
   return UNZ_OK if there is no problem. */
 
+extern void ZEXPORT unzSetAllocFunctions OF((alloc_func zalloc, free_func zfree, voidpf opaque));
+/*
+  Make every allocation of unzip, including the inflate streams it creates,
+    go through zalloc and zfree (called like the z_stream ones, with opaque).
+    Passing NULL restores malloc and free. Memory is released with the
+    functions current at that time, so only change them while no zipfile is
+    open. */
+
+extern int ZEXPORT unzSetReadBufferSize OF((unzFile file, uInt size));
+/*
+  Set the size of the buffer unzReadCurrentFile uses to read compressed data
+    (UNZ_BUFSIZE by default). It applies to the files opened afterwards with
+    unzOpenCurrentFile, so it can be tuned for the storage each zipfile is on.
+  return UNZ_OK if there is no problem. */
+
+extern int ZEXPORT unzSetStreamReuse OF((unzFile file, int reuse));
+/*
+  If reuse is not 0, unzCloseCurrentFile keeps the read buffer and the
+    initialised inflate stream, and the next unzOpenCurrentFile only resets
+    them instead of allocating and initialising new ones. They are freed by
+    unzClose or by calling this function with reuse 0.
+  return UNZ_OK if there is no problem. */
+
+extern int ZEXPORT unzSetCrcCheck OF((unzFile file, int check));
+/*
+  If check is 0, unzReadCurrentFile does not compute the crc32 of the data it
+    returns and unzCloseCurrentFile never reports UNZ_CRCERROR, for callers
+    that verify the data themselves. It is on by default and applies to the
+    files opened afterwards with unzOpenCurrentFile.
+  return UNZ_OK if there is no problem. */
+
 extern int ZEXPORT unzGetGlobalInfo OF((unzFile file,
                                         unz_global_info *pglobal_info));
 
@@ -1,139 +1,133 @@
 #include <os.h>
 #include "unzip.h"
-#include <nspireio.h>
+#include "pkginfo.h"
+#include "timer.h"
+#include "log.h"
+#include "profile.h"
+#include "platform.h"
 
-#define DEBUG_CONSOLE 0
+#define EXTRACT_BUFFER_SIZE 8192
+#define MEMORY_BACKEND_MAX_SIZE (512*1024)
+#define MEMORY_BACKEND_HEAP_RESERVE (96*1024) // inflate state and window, read and extraction buffers, manifests
+#define PACKAGE_READ_BUFFER_SIZE 8192 // compressed data read per call, a multiple of the flash page size
+#define PACKAGE_CACHE_BLOCK_SIZE 2048 // one flash page
+#define PACKAGE_CACHE_BLOCKS 4
 const char PACSPIRE_ROOT[] = "/pacspire";
+const char INDEX_FILE[] = "/pacspire/packages.idx.tns";
+const char INDEX_TMP_FILE[] = "/pacspire/packages.tmp.tns";
+const char NDLESS_CFG_FILE[] = "/documents/ndless/ndless.cfg.tns";
+const char NDLESS_CFG_TMP_FILE[] = "/documents/ndless/ndless.tmp.tns";
+const char LOG_FILE[] = "/pacspire/pacspire.log.tns";
+const char STATS_FILE[] = "/pacspire/pacspire.stats.tns";
 
-typedef struct
-{
-	char extension[15];
-	char program[15];
-} fileext;
+#define INDEX_MAGIC 0x49534350 // "PCSI"
+#define INDEX_VERSION 2
+
+#define MANIFEST_MAGIC 0x4d534350 // "PCSM"
+#define MANIFEST_VERSION 2 // 1 had no link and extension records
 
 typedef struct
 {
-	char name[30];
-	char program[15];
-} link;
+	unsigned int magic;
+	unsigned int version;
+	unsigned int count;
+} indexheader;
 
 typedef struct
 {
 	char name[21];
 	char version[11];
 	unsigned int timestamp;
-	
-	int ext_count;
-	fileext* extensions;
-	
-	int link_count;
-	link* links;
-} pkginfo;
+	unsigned int file_count;
+	unsigned int size;
+	char extensions[48]; // registered extensions, comma separated
+} indexentry;
+
+typedef struct
+{
+	int count;
+	indexentry* entries;
+} pkgindex;
+
+enum
+{
+	MANIFEST_FILE,
+	MANIFEST_DIR,
+	MANIFEST_LINK, // path is the absolute path of the launcher
+	MANIFEST_EXT // path is "extension=program" as registered in ndless.cfg
+};
+
+typedef struct
+{
+	unsigned char type;
+	unsigned char staged; // only used while installing
+	unsigned char reserved[2];
+	unsigned int crc;
+	unsigned int size;
+	char path[52];
+} manifestentry;
+
+typedef struct
+{
+	int count;
+	int capacity;
+	manifestentry* entries;
+} manifest;
+
+typedef struct
+{
+	unsigned int file_count;
+	unsigned int installed_size;
+	unsigned int files_written;
+	unsigned int files_unchanged;
+	unsigned int entries_removed;
+	unsigned int dirs_created;
+	unsigned long bytes_written;
+	unsigned int crc_time;
+	unsigned long largest_entry;
+} installstats;
+
+typedef char dirpath[52];
+
+// Directories created during one installation, sorted by path
+typedef struct
+{
+	int count;
+	int capacity;
+	dirpath* paths;
+} dirset;
+
+typedef struct arenablock
+{
+	struct arenablock* next; // every block of the arena
+	struct arenablock* next_free;
+	unsigned int size;
+	unsigned int reserved;
+} arenablock;
+
+typedef struct
+{
+	arenablock* blocks;
+	arenablock* free_blocks;
+	unsigned int in_use;
+	unsigned int peak;
+	unsigned int system_allocs;
+} arena;
 
 
 #define debug(s, ...) \
-	nio_printf(s, ##__VA_ARGS__)
+	logPrint(LOG_NORMAL,LOG_PLAIN,s, ##__VA_ARGS__)
 #define success(s, ...) \
-	nio_color(nio_get_default(),NIO_COLOR_WHITE,NIO_COLOR_GREEN); \
-	nio_printf(s, ##__VA_ARGS__); \
-	nio_color(nio_get_default(),NIO_COLOR_WHITE,NIO_COLOR_BLACK);
+	logPrint(LOG_NORMAL,LOG_SUCCESS,s, ##__VA_ARGS__)
 #define warn(s, ...) \
-	nio_color(nio_get_default(),NIO_COLOR_WHITE,NIO_COLOR_YELLOW); \
-	nio_printf(s, ##__VA_ARGS__); \
-	nio_color(nio_get_default(),NIO_COLOR_WHITE,NIO_COLOR_BLACK);
+	logPrint(LOG_QUIET,LOG_WARN,s, ##__VA_ARGS__)
 #define fail(s, ...) \
-	nio_color(nio_get_default(),NIO_COLOR_WHITE,NIO_COLOR_RED); \
-	nio_printf(s, ##__VA_ARGS__); \
-	nio_color(nio_get_default(),NIO_COLOR_WHITE,NIO_COLOR_BLACK);
-
-void freePackageInfo(pkginfo* p)
-{
-	free(p->extensions);
-	free(p->links);
-	free(p);
-}
-	
-pkginfo* parsePackageInfo(char* buffer)
-{
-	char* line;
-	pkginfo* p = malloc(sizeof(pkginfo));
-	p->name[0] = '\0';
-	p->version[0] = '\0';
-	p->timestamp = 0;
-	p->ext_count = 0;
-	p->extensions = NULL;
-	p->link_count = 0;
-	p->links = NULL;
-	
-	line = strtok(buffer,"\r\n");
-	while(line != NULL)
-	{
-		int len = strlen(line);
-		
-		int delimiter_pos = strcspn(line,"=");
-		if(delimiter_pos == len)
-		{
-			freePackageInfo(p);
-			return NULL;
-		}
-		
-		line[delimiter_pos] = '\0';
-		if(strcmp(line, "name") == 0)
-		{
-			strncpy(p->name,&line[delimiter_pos+1],20);
-			p->name[20] = '\0';
-		}
-		else if(strcmp(line, "version") == 0)
-		{
-			strncpy(p->version,&line[delimiter_pos+1],10);
-			p->name[10] = '\0';
-		}
-		else if(strcmp(line, "timestamp") == 0)
-		{
-			p->timestamp = (unsigned int)strtoul(&line[delimiter_pos+1],NULL,0);
-			if(p->timestamp == 0)
-			{
-				freePackageInfo(p);
-				return NULL;
-			}
-		}
-		else if(strcmp(line, "ext_name") == 0)
-		{
-			p->ext_count++;
-			p->extensions = realloc(p->extensions,p->ext_count*sizeof(fileext));
-			strncpy(p->extensions[p->ext_count-1].extension,&line[delimiter_pos+1],15);
-		}
-		else if(strcmp(line, "ext_prog") == 0)
-		{
-			strncpy(p->extensions[p->ext_count-1].program,&line[delimiter_pos+1],15);
-		}
-		else if(strcmp(line, "link_name") == 0)
-		{
-			p->link_count++;
-			p->links = realloc(p->links,p->link_count*sizeof(link));
-			strncpy(p->links[p->link_count-1].name,&line[delimiter_pos+1],30);
-		}
-		else if(strcmp(line, "link_prog") == 0)
-		{
-			strncpy(p->links[p->link_count-1].program,&line[delimiter_pos+1],15);
-		}
-		else
-		{
-			freePackageInfo(p);
-			return NULL;
-		}
-		
-		line = strtok(NULL,"\r\n");
-	}
-	
-	if(p->name[0] == '\0' || p->version[0] == '\0' || p->timestamp == 0)
-	{
-		freePackageInfo(p);
-		return NULL;
-	}
-	
-	return p;
-}
+	logPrint(LOG_QUIET,LOG_FAIL,s, ##__VA_ARGS__)
+// One line per file, only shown while installing in verbose mode
+#define detail(s, ...) \
+	logPrint(LOG_VERBOSE,LOG_PLAIN,s, ##__VA_ARGS__)
+#define detail_success(s, ...) \
+	logPrint(LOG_VERBOSE,LOG_SUCCESS,s, ##__VA_ARGS__)
 
 void* unzGetCurrentFileContent(unzFile uf)
 {
@@ -156,8 +150,13 @@ void* unzGetCurrentFileContent(unzFile uf)
 		return NULL;
 	}
 	buffer[file_info.uncompressed_size] = 0;
-	unzCloseCurrentFile(uf); // Detect CRC errors?
+	unzCloseCurrentFile(uf);
 	
+	if(crc32(0,(Bytef*)buffer,file_info.uncompressed_size) != file_info.crc)
+	{
+		free(buffer);
+		return NULL;
+	}
 	return buffer;
 }
 
@@ -172,14 +171,14 @@ void* unzGetFileContent(unzFile uf, const char* filename)
 void* getFileContent(const char* filename)
 {
 	struct stat s;
-	if(stat(filename,&s) == -1)
+	if(fsStat(filename,&s) == -1)
 		return NULL;
 	
-	FILE* f = fopen(filename,"rb");
+	FILE* f = fsOpen(filename,"rb");
 	if(f == NULL)
 		return NULL;
 	
-	void* buffer = malloc(s.st_size);
+	char* buffer = malloc(s.st_size+1);
 	if(buffer == NULL)
 	{
 		fclose(f);
@@ -192,6 +191,7 @@ void* getFileContent(const char* filename)
 		free(buffer);
 		return NULL;
 	}
+	buffer[s.st_size] = '\0';
 		
 	fclose(f);
 	return buffer;
@@ -199,7 +199,7 @@ void* getFileContent(const char* filename)
 
 int writeFileContent(const char* filename, void* buffer, size_t count)
 {
-	FILE* f = fopen(filename,"wb");
+	FILE* f = fsOpen(filename,"wb");
 	if(f == NULL)
 		return -1;
 		
@@ -213,12 +213,61 @@ int writeFileContent(const char* filename, void* buffer, size_t count)
 	return 0;
 }
 
+// Writes the current entry to filename and computes its crc on the way, the
+// time spent on the crc goes to PHASE_CRC
+int extractCurrentFile(unzFile uf, const char* filename, char* buffer, unsigned int buffer_size, unsigned long* crc)
+{
+	*crc = crc32(0,Z_NULL,0);
+	int phase = profileEnter(PHASE_INFLATE);
+	if(unzOpenCurrentFile(uf) != UNZ_OK)
+	{
+		profileEnter(phase);
+		return -1;
+	}
+	
+	profileEnter(PHASE_WRITE);
+	FILE* f = fsOpen(filename,"wb");
+	if(f == NULL)
+	{
+		unzCloseCurrentFile(uf);
+		profileEnter(phase);
+		return -1;
+	}
+	
+	int count;
+	profileEnter(PHASE_INFLATE);
+	while((count = unzReadCurrentFile(uf,buffer,buffer_size)) > 0)
+	{
+		profileEnter(PHASE_CRC);
+		*crc = crc32(*crc,(Bytef*)buffer,count);
+		
+		profileEnter(PHASE_WRITE);
+		if(fwrite(buffer,1,count,f) != (size_t)count)
+		{
+			fclose(f);
+			unzCloseCurrentFile(uf);
+			profileEnter(phase);
+			return -1;
+		}
+		profileEnter(PHASE_INFLATE);
+	}
+	
+	unzCloseCurrentFile(uf);
+	profileEnter(PHASE_WRITE);
+	int result = fclose(f);
+	profileEnter(phase);
+	if(result != 0)
+		return -1;
+	return count < 0 ? -1 : 0;
+}
+
 int createDir(const char *dir) {
 	char tmp[100];
 	char *p = NULL;
 	size_t len;
 
-	strncpy(tmp,dir,100);
+	strncpy(tmp,dir,sizeof(tmp) - 1);
+	tmp[sizeof(tmp) - 1] = '\0';
 	len = strlen(tmp);
 	if(tmp[len - 1] == '/' || tmp[len - 1] == '\\')
 		tmp[len - 1] = '\0';
@@ -227,365 +276,2195 @@ int createDir(const char *dir) {
 	{
 		if(*p == '/' || *p == '\\') {
 			*p = '\0';
-			if(mkdir(tmp, 0755) == -1 && errno != 17)
+			if(fsMkdir(tmp) == -1 && errno != 17)
 				return -1;
 			*p = '/';
 		}
 	}
-	if(mkdir(tmp, 0755) == -1 && errno != 17)
+	if(fsMkdir(tmp) == -1 && errno != 17)
 		return -1;
 		
 	return 0;
 }
 
-int removeDir(char* directory)
+// Deletes a directory tree and returns the number of removed entries, or -1.
+// Every entry is unlinked first and only opened as a directory when that
+// fails, directories still to visit are kept on a heap stack.
+int removeDir(const char* directory)
 {
-	DIR* dir;
-	struct dirent* entry;
-	
-	dir = opendir(directory);
-	if(dir == NULL)
+	int capacity = 16;
+	char** stack = malloc(capacity*sizeof(char*));
+	if(stack == NULL)
 		return -1;
-		
-	while((entry = readdir(dir)) != 0)
+	stack[0] = malloc(strlen(directory)+1);
+	if(stack[0] == NULL)
 	{
-		if(strcmp(entry->d_name,".") == 0 || strcmp(entry->d_name,"..") == 0)
-			continue;
-		
-		char full_path[100];
-		strcpy(full_path,directory);
-		strcat(full_path,"/");
-		strcat(full_path,entry->d_name);
-		
-		struct stat s;
-		if(stat(full_path,&s) == -1)
+		free(stack);
+		return -1;
+	}
+	strcpy(stack[0],directory);
+	
+	int depth = 1;
+	int removed = 0;
+	int failed = 0;
+	while(depth > 0 && !failed)
+	{
+		char* current = stack[depth-1];
+		DIR* dir = fsOpenDir(current);
+		if(dir == NULL)
 		{
-			closedir(dir);
-			return -1;
+			failed = 1;
+			break;
 		}
 		
-		if(s.st_mode & S_IFDIR)
+		int pushed = 0;
+		struct dirent* entry;
+		while((entry = readdir(dir)) != 0)
 		{
-			if(removeDir(full_path) == -1)
+			if(strcmp(entry->d_name,".") == 0 || strcmp(entry->d_name,"..") == 0)
+				continue;
+			
+			char* path = malloc(strlen(current)+strlen(entry->d_name)+2);
+			if(path == NULL)
 			{
-				closedir(dir);
-				return -1;
+				failed = 1;
+				break;
+			}
+			sprintf(path,"%s/%s",current,entry->d_name);
+			
+			if(fsUnlink(path) == 0)
+			{
+				removed++;
+				free(path);
+				continue;
 			}
+			
+			// Most likely a directory, visit it before coming back here
+			if(depth == capacity)
+			{
+				char** grown = realloc(stack,2*capacity*sizeof(char*));
+				if(grown == NULL)
+				{
+					free(path);
+					failed = 1;
+					break;
+				}
+				stack = grown;
+				capacity *= 2;
+			}
+			stack[depth++] = path;
+			pushed++;
 		}
-		else
+		closedir(dir);
+		
+		if(!failed && pushed == 0)
 		{
-			if(unlink(full_path) == -1)
+			if(fsRmdir(current) == -1)
 			{
-				closedir(dir);
-				return -1;
+				failed = 1;
+				break;
 			}
+			removed++;
+			free(current);
+			depth--;
 		}
 	}
 	
-	closedir(dir);
-	if(rmdir(directory) == -1)
-		return -1;
-	
-	return 0;
+	while(depth > 0)
+		free(stack[--depth]);
+	free(stack);
+	return failed ? -1 : removed;
 }
 
-enum
+void freeIndex(pkgindex* index)
 {
-	INSTALLATION_SUCCESS,
-	INSTALLATION_FAILED,
-	INSTALLATION_ABORTED
-};
+	free(index->entries);
+	free(index);
+}
 
-int installPackage(char* file)
+int readIndexFile(pkgindex* index, const char* filename)
 {
-	unzFile uf = NULL;
+	FILE* f = fsOpen(filename,"rb");
+	if(f == NULL)
+		return -1;
 	
-	debug("opening package...");
-	uf = unzOpen(file);
-	if(uf == NULL)
+	indexheader header;
+	if(fread(&header,sizeof(indexheader),1,f) != 1 || header.magic != INDEX_MAGIC || header.version != INDEX_VERSION)
 	{
-		fail(" failed\n");
-		return INSTALLATION_FAILED;
+		fclose(f);
+		return -1;
 	}
-	success(" done\n");
 	
-	debug("unzipping package info...");
-	void* buffer = unzGetFileContent(uf,"pkginfo.txt.tns");
-	if(buffer == NULL)
+	if(header.count > 0)
 	{
-		fail(" failed\n");
-		unzClose(uf);
-		free(buffer);
-		return INSTALLATION_FAILED;
+		index->entries = malloc(header.count*sizeof(indexentry));
+		if(index->entries == NULL || fread(index->entries,sizeof(indexentry),header.count,f) != header.count)
+		{
+			free(index->entries);
+			index->entries = NULL;
+			fclose(f);
+			return -1;
+		}
 	}
-	success(" done\n");
+	index->count = header.count;
 	
-	debug("parsing package info...");
-	pkginfo* p = parsePackageInfo(buffer);
-	free(buffer);
-	if(p == NULL)
+	fclose(f);
+	return 0;
+}
+
+int saveIndex(pkgindex* index)
+{
+	FILE* f = fsOpen(INDEX_TMP_FILE,"wb");
+	if(f == NULL)
+		return -1;
+	
+	indexheader header;
+	header.magic = INDEX_MAGIC;
+	header.version = INDEX_VERSION;
+	header.count = index->count;
+	if(fwrite(&header,sizeof(indexheader),1,f) != 1
+		|| (index->count > 0 && fwrite(index->entries,sizeof(indexentry),index->count,f) != (size_t)index->count))
 	{
-		fail(" failed\n");
-		unzClose(uf);
-		return INSTALLATION_FAILED;
+		fclose(f);
+		fsUnlink(INDEX_TMP_FILE);
+		return -1;
 	}
-	success(" done\n");
+	fclose(f);
 	
-	debug("Package %s\n",p->name);
-	debug("Version: %s\n",p->version);
-	debug("Timestamp: %d\n",p->timestamp);
+	fsUnlink(INDEX_FILE);
+	if(fsRename(INDEX_TMP_FILE,INDEX_FILE) == -1)
+		return -1;
 	
-	debug("checking if package is already installed...");
-	char full_path[50];
-	sprintf(full_path,"%s/%s",PACSPIRE_ROOT,p->name);
-	struct stat s;
-	if(stat(full_path,&s) == 0)
+	return 0;
+}
+
+// Returns the position of name in the index, or -(insertion point)-1 if it is not there
+int searchIndex(pkgindex* index, const char* name)
+{
+	int low = 0;
+	int high = index->count - 1;
+	while(low <= high)
 	{
-		warn(" yes\n");
-		
-		debug("opening installed pkginfo.txt.tns...");
-		char pkginfo_path[60];
-		sprintf(pkginfo_path,"%s/pkginfo.txt.tns",full_path);
-		buffer = getFileContent(pkginfo_path);
-		if(buffer == NULL)
-		{
-			fail(" failed\n");
-			freePackageInfo(p);
-			unzClose(uf);
-			return INSTALLATION_FAILED;
-		}
-		success(" done\n");
-		
-		debug("parsing installed pkginfo.txt.tns...");
-		pkginfo* p2 = parsePackageInfo(buffer);
-		free(buffer);
-		if(p2 == NULL)
-		{
-			fail(" failed\n");
-			freePackageInfo(p);
-			unzClose(uf);
-			return INSTALLATION_FAILED;
-		}
-		success(" done\n");
-		
-		debug("checking if the package is newer than the installed version...");
-		char message[200];
-		if(p->timestamp <= p2->timestamp)
-		{
-			warn(" no\n");
-			sprintf(message,"You already have a newer or the same version of %s installed.",p->name);
-			if(show_msgbox_2b("pacspire",message,"OK","Force installation") == 1)
-			{
-				fail("Installation aborted\n");
-				freePackageInfo(p);
-				freePackageInfo(p2);
-				unzClose(uf);
-				return INSTALLATION_ABORTED;
-			}
-		}
+		int mid = (low + high) / 2;
+		int cmp = strcmp(index->entries[mid].name,name);
+		if(cmp == 0)
+			return mid;
+		else if(cmp < 0)
+			low = mid + 1;
 		else
-		{
-			success(" yes\n");
-			sprintf(message,"Do you want to update %s (%s -> %s)?",p->name,p2->version,p->version);
-			if(show_msgbox_2b("pacspire",message,"Yes","No") == 2)
-			{
-				fail("Installation aborted by user\n");
-				freePackageInfo(p);
-				freePackageInfo(p2);
-				unzClose(uf);
-				return INSTALLATION_ABORTED;
-			}
-		}
-		
-		freePackageInfo(p2);
-		
-		debug("Removing previous installation...");
-		if(removeDir(full_path) == -1)
-		{
-			debug(" failed\n");
-			freePackageInfo(p);
-			unzClose(uf);
-			return INSTALLATION_FAILED;
-		}
-		success(" done\n");
+			high = mid - 1;
 	}
-	else
+	return -low - 1;
+}
+
+indexentry* findIndexEntry(pkgindex* index, const char* name)
+{
+	int pos = searchIndex(index,name);
+	if(pos < 0)
+		return NULL;
+	return &index->entries[pos];
+}
+
+int updateIndexEntry(pkgindex* index, const indexentry* entry)
+{
+	int pos = searchIndex(index,entry->name);
+	if(pos >= 0)
 	{
-		success(" no\n");
-		char message[50];
-		sprintf(message,"Do you want to install %s?",p->name);
-		if(show_msgbox_2b("pacspire",message,"Install","Cancel") == 2)
-		{
-			fail("Installation aborted by user\n");
-			freePackageInfo(p);
-			unzClose(uf);
-			return INSTALLATION_ABORTED;
-		}
+		index->entries[pos] = *entry;
+		return 0;
 	}
 	
-	debug("Creating directory %s...",full_path);
-	if(mkdir(full_path, 0755) == -1)
-	{
-		if(errno == 17) // == EEXIST
-		{
-			warn(" exists\n");
-		}
-		else
-		{
-			fail(" failed\n");
-			freePackageInfo(p);
+	pos = -pos - 1;
+	indexentry* entries = realloc(index->entries,(index->count+1)*sizeof(indexentry));
+	if(entries == NULL)
+		return -1;
+	
+	memmove(&entries[pos+1],&entries[pos],(index->count-pos)*sizeof(indexentry));
+	entries[pos] = *entry;
+	index->entries = entries;
+	index->count++;
+	return 0;
+}
+
+int removeIndexEntry(pkgindex* index, const char* name)
+{
+	int pos = searchIndex(index,name);
+	if(pos < 0)
+		return -1;
+	
+	memmove(&index->entries[pos],&index->entries[pos+1],(index->count-pos-1)*sizeof(indexentry));
+	index->count--;
+	return 0;
+}
+
+void freeManifest(manifest* m)
+{
+	free(m->entries);
+	free(m);
+}
+
+manifest* createManifest(int capacity)
+{
+	manifest* m = malloc(sizeof(manifest));
+	if(m == NULL)
+		return NULL;
+	
+	m->count = 0;
+	m->capacity = capacity > 0 ? capacity : 1;
+	m->entries = malloc(m->capacity*sizeof(manifestentry));
+	if(m->entries == NULL)
+	{
+		free(m);
+		return NULL;
+	}
+	return m;
+}
+
+int addManifestEntry(manifest* m, unsigned char type, const char* path, unsigned int crc, unsigned int size)
+{
+	if(strlen(path) >= sizeof(m->entries[0].path))
+		return -1;
+	
+	if(m->count == m->capacity)
+	{
+		int capacity = m->capacity > 0 ? 2*m->capacity : 16;
+		manifestentry* entries = realloc(m->entries,capacity*sizeof(manifestentry));
+		if(entries == NULL)
+			return -1;
+		m->entries = entries;
+		m->capacity = capacity;
+	}
+	
+	manifestentry* entry = &m->entries[m->count++];
+	memset(entry,0,sizeof(manifestentry));
+	entry->type = type;
+	entry->crc = crc;
+	entry->size = size;
+	strcpy(entry->path,path);
+	return 0;
+}
+
+int compareManifestEntries(const void* a, const void* b)
+{
+	return strcmp(((const manifestentry*)a)->path,((const manifestentry*)b)->path);
+}
+
+void sortManifest(manifest* m)
+{
+	qsort(m->entries,m->count,sizeof(manifestentry),compareManifestEntries);
+}
+
+// The manifest has to be sorted
+manifestentry* findManifestEntry(manifest* m, const char* path)
+{
+	int low = 0;
+	int high = m->count - 1;
+	while(low <= high)
+	{
+		int mid = (low + high) / 2;
+		int cmp = strcmp(m->entries[mid].path,path);
+		if(cmp == 0)
+			return &m->entries[mid];
+		else if(cmp < 0)
+			low = mid + 1;
+		else
+			high = mid - 1;
+	}
+	return NULL;
+}
+
+manifest* loadManifest(const char* name)
+{
+	char path[50];
+	sprintf(path,"%s/%s.man.tns",PACSPIRE_ROOT,name);
+	FILE* f = fsOpen(path,"rb");
+	if(f == NULL)
+		return NULL;
+	
+	indexheader header;
+	if(fread(&header,sizeof(indexheader),1,f) != 1 || header.magic != MANIFEST_MAGIC || header.version < 1 || header.version > MANIFEST_VERSION)
+	{
+		fclose(f);
+		return NULL;
+	}
+	
+	manifest* m = createManifest(header.count);
+	if(m == NULL)
+	{
+		fclose(f);
+		return NULL;
+	}
+	
+	if(fread(m->entries,sizeof(manifestentry),header.count,f) != header.count)
+	{
+		freeManifest(m);
+		fclose(f);
+		return NULL;
+	}
+	m->count = header.count;
+	
+	fclose(f);
+	return m;
+}
+
+// Comma separated list of the extensions a package registers, cut off when they do not fit
+void joinExtensions(char* dest, int size, const pkginfo* p)
+{
+	int len = 0;
+	int i;
+	dest[0] = '\0';
+	for(i = 0; i < p->ext_count; i++)
+	{
+		int ext_len = strlen(p->extensions[i].extension);
+		if(len + ext_len + 2 > size)
+			break;
+		if(len > 0)
+			dest[len++] = ',';
+		strcpy(&dest[len],p->extensions[i].extension);
+		len += ext_len;
+	}
+}
+
+// Recreates the index from the package directories and their manifests,
+// this is the slow path that the index exists to avoid
+void rebuildIndex(pkgindex* index)
+{
+	DIR* dir = fsOpenDir(PACSPIRE_ROOT);
+	if(dir == NULL)
+		return;
+	
+	struct dirent* entry;
+	while((entry = readdir(dir)) != 0)
+	{
+		if(entry->d_name[0] == '.' || strlen(entry->d_name) > 20)
+			continue;
+		
+		char path[50];
+		sprintf(path,"%s/%s/pkginfo.txt.tns",PACSPIRE_ROOT,entry->d_name);
+		char* buffer = getFileContent(path);
+		if(buffer == NULL)
+			continue;
+		pkginfo* p = parsePackageInfo(buffer);
+		free(buffer);
+		
+		// Staging directories have a pkginfo too, but not under the package name
+		if(p == NULL || strcmp(p->name,entry->d_name) != 0)
+		{
+			if(p != NULL)
+				freePackageInfo(p);
+			continue;
+		}
+		
+		indexentry e;
+		memset(&e,0,sizeof(indexentry));
+		strcpy(e.name,p->name);
+		strcpy(e.version,p->version);
+		e.timestamp = p->timestamp;
+		joinExtensions(e.extensions,sizeof(e.extensions),p);
+		
+		manifest* m = loadManifest(p->name);
+		if(m != NULL)
+		{
+			int i;
+			for(i = 0; i < m->count; i++)
+			{
+				if(m->entries[i].type == MANIFEST_FILE)
+				{
+					e.file_count++;
+					e.size += m->entries[i].size;
+				}
+			}
+			freeManifest(m);
+		}
+		
+		updateIndexEntry(index,&e);
+		freePackageInfo(p);
+	}
+	
+	closedir(dir);
+}
+
+pkgindex* loadIndex()
+{
+	pkgindex* index = malloc(sizeof(pkgindex));
+	if(index == NULL)
+		return NULL;
+	index->count = 0;
+	index->entries = NULL;
+	
+	// A leftover temporary file means saveIndex was interrupted after removing the old index
+	if(readIndexFile(index,INDEX_FILE) == -1 && readIndexFile(index,INDEX_TMP_FILE) == -1)
+	{
+		// Missing or written by an older version, rebuild it once and keep it
+		rebuildIndex(index);
+		saveIndex(index);
+	}
+	
+	return index;
+}
+
+// Sorts the manifest and writes it next to the package directory
+int saveManifest(const char* name, manifest* m)
+{
+	char path[50];
+	char tmp_path[50];
+	sprintf(path,"%s/%s.man.tns",PACSPIRE_ROOT,name);
+	sprintf(tmp_path,"%s/%s.mtmp.tns",PACSPIRE_ROOT,name);
+	
+	sortManifest(m);
+	int i;
+	for(i = 0; i < m->count; i++)
+		m->entries[i].staged = 0;
+	
+	FILE* f = fsOpen(tmp_path,"wb");
+	if(f == NULL)
+		return -1;
+	
+	indexheader header;
+	header.magic = MANIFEST_MAGIC;
+	header.version = MANIFEST_VERSION;
+	header.count = m->count;
+	if(fwrite(&header,sizeof(indexheader),1,f) != 1
+		|| (m->count > 0 && fwrite(m->entries,sizeof(manifestentry),m->count,f) != (size_t)m->count))
+	{
+		fclose(f);
+		fsUnlink(tmp_path);
+		return -1;
+	}
+	fclose(f);
+	
+	fsUnlink(path);
+	if(fsRename(tmp_path,path) == -1)
+		return -1;
+	
+	return 0;
+}
+
+// Returns the position of path in the set, or -(insertion point)-1 if it is not there
+int searchDirSet(dirset* set, const char* path)
+{
+	int low = 0;
+	int high = set->count - 1;
+	while(low <= high)
+	{
+		int mid = (low + high) / 2;
+		int cmp = strcmp(set->paths[mid],path);
+		if(cmp == 0)
+			return mid;
+		else if(cmp < 0)
+			low = mid + 1;
+		else
+			high = mid - 1;
+	}
+	return -low - 1;
+}
+
+// Creates path (relative to dir, ending with a slash) and its parents, each
+// directory gets one mkdir per installation and one manifest entry
+int ensureDir(const char* dir, const char* path, dirset* set, manifest* new_manifest, installstats* stats)
+{
+	dirpath prefix;
+	const char* slash;
+	for(slash = strchr(path,'/'); slash != NULL; slash = strchr(slash + 1,'/'))
+	{
+		int len = slash - path + 1;
+		if(len >= (int)sizeof(dirpath))
+			return -1;
+		memcpy(prefix,path,len);
+		prefix[len] = '\0';
+		
+		int pos = searchDirSet(set,prefix);
+		if(pos >= 0)
+			continue;
+		pos = -pos - 1;
+		
+		char dir_path[100];
+		sprintf(dir_path,"%s/%s",dir,prefix);
+		dir_path[strlen(dir_path)-1] = '\0';
+		int phase = profileEnter(PHASE_MKDIR);
+		int result = fsMkdir(dir_path);
+		profileEnter(phase);
+		if(result == -1 && errno != 17)
+			return -1;
+		stats->dirs_created++;
+		profileCount(COUNTER_DIRS,1);
+		
+		if(set->count == set->capacity)
+		{
+			int capacity = set->capacity > 0 ? 2*set->capacity : 16;
+			dirpath* paths = realloc(set->paths,capacity*sizeof(dirpath));
+			if(paths == NULL)
+				return -1;
+			set->paths = paths;
+			set->capacity = capacity;
+		}
+		memmove(&set->paths[pos+1],&set->paths[pos],(set->count-pos)*sizeof(dirpath));
+		strcpy(set->paths[pos],prefix);
+		set->count++;
+		
+		if(addManifestEntry(new_manifest,MANIFEST_DIR,prefix,0,0) == -1)
+			return -1;
+	}
+	return 0;
+}
+
+// Extracts every entry of the package into the staging directory dir. Files listed
+// in old_manifest with the same CRC32 and size as in the central directory are
+// skipped; the new manifest marks every file that was written as staged.
+int extractPackage(unzFile uf, const char* dir, manifest* old_manifest, manifest* new_manifest, char* buffer, installstats* stats)
+{
+	debug("Going to first file in zip...");
+	if(unzGoToFirstFile(uf) != UNZ_OK)
+	{
+		fail(" failed\n");
+		return -1;
+	}
+	success(" done\n");
+	
+	// Archives do not have to list the parents of their files, and a
+	// directory listed after one of its files must not be created twice
+	dirset dirs;
+	dirs.count = 0;
+	dirs.capacity = 0;
+	dirs.paths = NULL;
+	
+	do
+	{
+		char filename[50];
+		unz_file_info file_info;
+		unzGetCurrentFileInfo(uf,&file_info,filename,50,NULL,0,NULL,0);
+		
+		if(filename[strlen(filename)-1] == '/')
+		{
+			detail("Creating directory %s...",filename);
+			if(ensureDir(dir,filename,&dirs,new_manifest,stats) == -1)
+			{
+				fail(" failed\n");
+				free(dirs.paths);
+				return -1;
+			}
+			detail_success(" done\n");
+		}
+		else
+		{
+			// Kept files need the records of their directories too, or the next
+			// upgrade or removal would not know about them
+			if(ensureDir(dir,filename,&dirs,new_manifest,stats) == -1)
+			{
+				fail("Could not create the directories of %s\n",filename);
+				free(dirs.paths);
+				return -1;
+			}
+			
+			int staged = 0;
+			manifestentry* old_entry = old_manifest != NULL ? findManifestEntry(old_manifest,filename) : NULL;
+			if(old_entry != NULL && old_entry->type == MANIFEST_FILE
+				&& old_entry->crc == file_info.crc && old_entry->size == file_info.uncompressed_size)
+			{
+				detail("Keeping unchanged file %s\n",filename);
+				stats->files_unchanged++;
+			}
+			else
+			{
+				detail("Extracting file %s (%lu bytes)...",filename,file_info.uncompressed_size);
+				unsigned int start = getMicroseconds();
+				unsigned int crc_start = profileTime(PHASE_CRC);
+				char file_path[100];
+				unsigned long crc;
+				sprintf(file_path,"%s/%s",dir,filename);
+				if(extractCurrentFile(uf,file_path,buffer,EXTRACT_BUFFER_SIZE,&crc) == -1)
+				{
+					fail(" failed\n");
+					free(dirs.paths);
+					return -1;
+				}
+				if(crc != file_info.crc)
+				{
+					fail(" CRC mismatch, %s is corrupted\n",filename);
+					free(dirs.paths);
+					return -1;
+				}
+				unsigned int time = getMicroseconds() - start;
+				detail_success(" done in %u us (CRC %u us)\n",time,profileTime(PHASE_CRC) - crc_start);
+				profileEntry(filename,time);
+				profileCount(COUNTER_BYTES_IN,file_info.compressed_size);
+				profileCount(COUNTER_BYTES_OUT,file_info.uncompressed_size);
+				profileCount(COUNTER_FILES,1);
+				stats->files_written++;
+				stats->bytes_written += file_info.uncompressed_size;
+				staged = 1;
+			}
+			
+			if(addManifestEntry(new_manifest,MANIFEST_FILE,filename,file_info.crc,file_info.uncompressed_size) == -1)
+			{
+				fail("Could not record %s in the manifest\n",filename);
+				free(dirs.paths);
+				return -1;
+			}
+			new_manifest->entries[new_manifest->count-1].staged = staged;
+			
+			if(file_info.uncompressed_size > stats->largest_entry)
+				stats->largest_entry = file_info.uncompressed_size;
+			stats->file_count++;
+			stats->installed_size += file_info.uncompressed_size;
+		}
+	}
+	while(unzGoToNextFile(uf) == UNZ_OK);
+	
+	free(dirs.paths);
+	return 0;
+}
+
+// Contents of ndless.cfg as last read, so that the packages of a batch do not
+// register the same extensions again; NULL until needed and after every change
+char* ndless_cfg = NULL;
+
+void forgetNdlessConfig()
+{
+	free(ndless_cfg);
+	ndless_cfg = NULL;
+}
+
+// Returns whether ndless.cfg has the line "ext.<extension>=<program>"
+int isExtensionRegistered(const char* extension, const char* program)
+{
+	if(ndless_cfg == NULL)
+		ndless_cfg = getFileContent(NDLESS_CFG_FILE);
+	if(ndless_cfg == NULL)
+		return 0;
+	
+	char line[60];
+	sprintf(line,"ext.%s=%s",extension,program);
+	int line_len = strlen(line);
+	const char* in = ndless_cfg;
+	while(*in != '\0')
+	{
+		int len = strcspn(in,"\r\n");
+		if(len == line_len && memcmp(in,line,len) == 0)
+			return 1;
+		in += len + strspn(in + len,"\r\n");
+	}
+	return 0;
+}
+
+// Every registration rewrites ndless.cfg, skip the ones that are already there
+void registerExtension(const char* extension, const char* program)
+{
+	debug("Registering extension %s for %s...",extension,program);
+	if(isExtensionRegistered(extension,program))
+	{
+		success(" already registered\n");
+		return;
+	}
+	registerFileExtension(extension,program);
+	forgetNdlessConfig();
+	success(" done\n");
+}
+
+// Drops the "ext.<extension>=<program>" line registerFileExtension added, if
+// the extension has not been given to another program since
+int unregisterExtension(const char* record)
+{
+	forgetNdlessConfig();
+	// Without ndless.cfg there is nothing to unregister
+	struct stat s;
+	if(fsStat(NDLESS_CFG_FILE,&s) == -1 && errno == 2)
+		return 0;
+	char* content = getFileContent(NDLESS_CFG_FILE);
+	if(content == NULL)
+		return -1;
+	
+	char line[60];
+	sprintf(line,"ext.%s",record);
+	int line_len = strlen(line);
+	
+	char* out = content;
+	char* in = content;
+	int removed = 0;
+	while(*in != '\0')
+	{
+		int len = strcspn(in,"\r\n");
+		int end = len + strspn(in + len,"\r\n");
+		if(len == line_len && memcmp(in,line,len) == 0)
+			removed = 1;
+		else
+		{
+			memmove(out,in,end);
+			out += end;
+		}
+		in += end;
+	}
+	
+	if(removed)
+	{
+		if(writeFileContent(NDLESS_CFG_TMP_FILE,content,out - content) == -1)
+		{
+			free(content);
+			return -1;
+		}
+		fsUnlink(NDLESS_CFG_FILE);
+		if(fsRename(NDLESS_CFG_TMP_FILE,NDLESS_CFG_FILE) == -1)
+		{
+			free(content);
+			return -1;
+		}
+	}
+	
+	free(content);
+	return 0;
+}
+
+// Deletes what a manifest entry installed below dir, returns 1 for directories
+// that still have content
+int removeManifestEntry(const char* dir, const manifestentry* entry)
+{
+	char path[100];
+	switch(entry->type)
+	{
+		case MANIFEST_FILE:
+			sprintf(path,"%s/%s",dir,entry->path);
+			// Already gone is as good as removed
+			return (fsUnlink(path) == -1 && errno != 2) ? -1 : 0;
+			
+		case MANIFEST_DIR:
+			sprintf(path,"%s/%s",dir,entry->path);
+			path[strlen(path)-1] = '\0';
+			return (fsRmdir(path) == -1 && errno != 2) ? 1 : 0;
+			
+		case MANIFEST_LINK:
+			return (fsUnlink(entry->path) == -1 && errno != 2) ? -1 : 0;
+			
+		case MANIFEST_EXT:
+			return unregisterExtension(entry->path);
+	}
+	return -1;
+}
+
+// Deletes everything listed in old_manifest that keep does not contain, or all of it if keep is NULL.
+// Both manifests have to be sorted; walking backwards removes children before their parents.
+int removeManifestEntries(const char* dir, manifest* old_manifest, manifest* keep, installstats* stats)
+{
+	int i;
+	for(i = old_manifest->count - 1; i >= 0; i--)
+	{
+		manifestentry* entry = &old_manifest->entries[i];
+		if(keep != NULL)
+		{
+			manifestentry* kept = findManifestEntry(keep,entry->path);
+			if(kept != NULL && kept->type == entry->type)
+				continue;
+		}
+		
+		detail("Removing %s...",entry->path);
+		int result = removeManifestEntry(dir,entry);
+		if(result == 1)
+		{
+			// The user may have put files there
+			warn(" not empty\n");
+			continue;
+		}
+		else if(result == -1)
+		{
+			fail(" failed\n");
+			return -1;
+		}
+		detail_success(" done\n");
+		stats->entries_removed++;
+	}
+	return 0;
+}
+
+// Records the extensions and launchers of a package so that upgrades and
+// removal can take them back
+int addPackageRecords(manifest* m, const pkginfo* p)
+{
+	char record[52];
+	int i;
+	for(i = 0; i < p->ext_count; i++)
+	{
+		sprintf(record,"%s=%s",p->extensions[i].extension,p->extensions[i].program);
+		if(addManifestEntry(m,MANIFEST_EXT,record,0,0) == -1)
+			return -1;
+	}
+	for(i = 0; i < p->link_count; i++)
+	{
+		sprintf(record,"/documents/%s.lnk.tns",p->links[i].name);
+		if(addManifestEntry(m,MANIFEST_LINK,record,0,0) == -1)
+			return -1;
+	}
+	return 0;
+}
+
+enum
+{
+	COMMIT_DIR_CREATED = 1,
+	COMMIT_FILE_MOVED = 2,
+	COMMIT_FILE_DISPLACED = 4
+};
+
+// Undoes the first count steps of commitStagedFiles in reverse order, so that
+// files come back before their directories are removed
+void rollbackStagedFiles(const char* dir, const char* old_dir, manifest* new_manifest, unsigned char* steps, int count)
+{
+	int i;
+	for(i = count - 1; i >= 0; i--)
+	{
+		char path[100];
+		char old_path[72];
+		sprintf(path,"%s/%s",dir,new_manifest->entries[i].path);
+		sprintf(old_path,"%s/%d",old_dir,i);
+		if(steps[i] & COMMIT_DIR_CREATED)
+		{
+			path[strlen(path)-1] = '\0';
+			fsRmdir(path);
+		}
+		if(steps[i] & COMMIT_FILE_MOVED)
+			fsUnlink(path);
+		if(steps[i] & COMMIT_FILE_DISPLACED)
+			fsRename(old_path,path);
+	}
+}
+
+// Moves the staged files of an upgrade into the installed tree. The files they
+// replace are kept in <dir>.old until every file is in place, so that a failure
+// puts them back and the installation stays as the old manifest describes it.
+// The staging directory is removed either way.
+int commitStagedFiles(const char* staging_dir, const char* dir, manifest* new_manifest)
+{
+	char old_dir[60];
+	sprintf(old_dir,"%s.old",dir);
+	removeDir(old_dir);
+	unsigned char* steps = calloc(new_manifest->count > 0 ? new_manifest->count : 1,1);
+	if(steps == NULL || fsMkdir(old_dir) == -1)
+	{
+		fail("Could not create %s\n",old_dir);
+		free(steps);
+		removeDir(staging_dir);
+		return -1;
+	}
+	
+	int i;
+	for(i = 0; i < new_manifest->count; i++)
+	{
+		manifestentry* entry = &new_manifest->entries[i];
+		char path[100];
+		sprintf(path,"%s/%s",dir,entry->path);
+		
+		if(entry->type == MANIFEST_DIR)
+		{
+			path[strlen(path)-1] = '\0';
+			if(fsMkdir(path) == 0)
+				steps[i] = COMMIT_DIR_CREATED;
+			else if(errno != 17)
+			{
+				fail("Could not create %s\n",path);
+				break;
+			}
+		}
+		else if(entry->staged)
+		{
+			// Named after the position in the manifest, so that .old needs no subdirectories
+			char old_path[72];
+			sprintf(old_path,"%s/%d",old_dir,i);
+			struct stat s;
+			if(fsStat(path,&s) == 0)
+			{
+				if(fsRename(path,old_path) == -1)
+				{
+					fail("Could not move %s aside\n",entry->path);
+					break;
+				}
+				steps[i] = COMMIT_FILE_DISPLACED;
+			}
+			
+			char staged_path[100];
+			sprintf(staged_path,"%s/%s",staging_dir,entry->path);
+			if(fsRename(staged_path,path) == -1)
+			{
+				fail("Could not move %s into place\n",entry->path);
+				break;
+			}
+			steps[i] |= COMMIT_FILE_MOVED;
+		}
+	}
+	
+	// The failed step may have moved the old file aside already
+	int result = 0;
+	if(i < new_manifest->count)
+	{
+		rollbackStagedFiles(dir,old_dir,new_manifest,steps,i + 1);
+		result = -1;
+	}
+	free(steps);
+	removeDir(old_dir);
+	removeDir(staging_dir);
+	return result;
+}
+
+// Replaces dir with the staging directory, keeping dir until the swap succeeded
+int commitStagedDirectory(const char* staging_dir, const char* dir)
+{
+	struct stat s;
+	if(fsStat(dir,&s) == -1)
+		return fsRename(staging_dir,dir);
+	
+	char old_dir[60];
+	sprintf(old_dir,"%s.old",dir);
+	removeDir(old_dir);
+	if(fsRename(dir,old_dir) == -1)
+		return -1;
+	
+	if(fsRename(staging_dir,dir) == -1)
+	{
+		fsRename(old_dir,dir);
+		return -1;
+	}
+	
+	removeDir(old_dir);
+	return 0;
+}
+
+// minizip and zlib allocate the same few block sizes for every entry (read
+// info, read buffer, inflate state and window), freed blocks are kept for the
+// next allocation of the same size and only given back by arenaReset
+voidpf arenaAlloc(voidpf opaque, uInt items, uInt size)
+{
+	arena* a = (arena*)opaque;
+	unsigned int bytes = (items * size + 7) & ~7;
+	arenablock** prev = &a->free_blocks;
+	arenablock* b = a->free_blocks;
+	while(b != NULL && b->size != bytes)
+	{
+		prev = &b->next_free;
+		b = b->next_free;
+	}
+	
+	if(b != NULL)
+		*prev = b->next_free;
+	else
+	{
+		b = malloc(sizeof(arenablock) + bytes);
+		if(b == NULL)
+			return NULL;
+		b->size = bytes;
+		b->next = a->blocks;
+		a->blocks = b;
+		a->system_allocs++;
+	}
+	
+	a->in_use += bytes;
+	if(a->in_use > a->peak)
+		a->peak = a->in_use;
+	return b + 1;
+}
+
+void arenaFree(voidpf opaque, voidpf address)
+{
+	arena* a = (arena*)opaque;
+	arenablock* b = (arenablock*)address - 1;
+	b->next_free = a->free_blocks;
+	a->free_blocks = b;
+	a->in_use -= b->size;
+}
+
+void arenaReset(arena* a)
+{
+	while(a->blocks != NULL)
+	{
+		arenablock* next = a->blocks->next;
+		free(a->blocks);
+		a->blocks = next;
+	}
+	a->free_blocks = NULL;
+	a->in_use = 0;
+	a->peak = 0;
+	a->system_allocs = 0;
+}
+
+// Install session arena, plugged into minizip while a package is installed
+arena session_arena;
+
+// Read-ahead cache for packages too large for the memory backend, it has to
+// outlive the unzFile and there is only ever one package open
+zlib_cache_def package_cache;
+
+// Loads small packages into RAM so that all zip I/O is served from one buffer,
+// and opens everything else from the filesystem
+unzFile openPackage(const char* file)
+{
+	int phase = profileEnter(PHASE_OPEN);
+	unzFile uf = NULL;
+	struct stat s;
+	package_cache.base_reads = 0;
+	package_cache.base_seeks = 0;
+	if(fsStat(file,&s) == 0 && s.st_size <= MEMORY_BACKEND_MAX_SIZE)
+	{
+		// There is no way to ask the OS for free heap, so check that the archive
+		// and everything the installation needs besides it can be allocated
+		void* probe = malloc(s.st_size + MEMORY_BACKEND_HEAP_RESERVE);
+		if(probe != NULL)
+		{
+			free(probe);
+			
+			zlib_filefunc64_def filefunc;
+			zlib_mem_def mem;
+			mem.max_size = MEMORY_BACKEND_MAX_SIZE;
+			fill_memory_filefunc64(&filefunc,&mem);
+			uf = unzOpen2_64(fsPath(file),&filefunc);
+			if(uf != NULL)
+				debug(" (%lu bytes in memory)",mem.size);
+		}
+	}
+	
+	if(uf == NULL)
+	{
+		// Central directory records and local headers are small reads all over the
+		// archive, serve them from whole pages and skip seeks to where we already are
+		zlib_filefunc64_def filefunc;
+		fill_fopen64_filefunc(&package_cache.base);
+		package_cache.block_size = PACKAGE_CACHE_BLOCK_SIZE;
+		package_cache.block_count = PACKAGE_CACHE_BLOCKS;
+		fill_cached_filefunc64(&filefunc,&package_cache);
+		uf = unzOpen2_64(fsPath(file),&filefunc);
+	}
+	
+	if(uf != NULL)
+	{
+		unzSetReadBufferSize(uf,PACKAGE_READ_BUFFER_SIZE);
+		// Every entry is checked against its CRC while it is extracted, where
+		// the cost can be logged, so minizip does not need to compute it too
+		unzSetCrcCheck(uf,0);
+		// Packages are mostly many small entries, keep one inflate state for all of them
+		unzSetStreamReuse(uf,1);
+	}
+	profileEnter(phase);
+	return uf;
+}
+
+// Shows a dialog with two buttons and returns the one that was clicked, the
+// log is drawn first and the time spent waiting is not part of the profile
+int askUser(const char* message, const char* button1, const char* button2)
+{
+	logFlush();
+	int phase = profileEnter(PHASE_DIALOG);
+	int button = showDialog(message,button1,button2,NULL);
+	profileEnter(phase);
+	return button;
+}
+
+enum
+{
+	INSTALLATION_SUCCESS,
+	INSTALLATION_FAILED,
+	INSTALLATION_ABORTED
+};
+
+// Reads the record pcsbuild writes into the comment of a package, which is already
+// in memory after unzOpen. NULL if there is none or it does not describe the archive.
+pkginfo* readPackageRecord(unzFile uf)
+{
+	unz_global_info gi;
+	if(unzGetGlobalInfo(uf,&gi) != UNZ_OK || gi.size_comment == 0)
+		return NULL;
+	void* buffer = malloc(gi.size_comment);
+	if(buffer == NULL)
+		return NULL;
+	pkginfo* p = NULL;
+	if(unzGetGlobalComment(uf,buffer,gi.size_comment) == (int)gi.size_comment)
+		p = parsePackageRecord(buffer,gi.size_comment);
+	free(buffer);
+	if(p == NULL)
+		return NULL;
+	
+	// Another tool can keep the comment when it adds or removes entries or
+	// replaces pkginfo.txt.tns, which pcsbuild writes as the first entry
+	char filename[15]; // minizip does not terminate names that fill the buffer
+	unz_file_info file_info;
+	if(p->entry_count != gi.number_entry
+		|| unzGoToFirstFile(uf) != UNZ_OK
+		|| unzGetCurrentFileInfo(uf,&file_info,filename,sizeof(filename),NULL,0,NULL,0) != UNZ_OK
+		|| file_info.size_filename != sizeof(filename) || memcmp(filename,"pkginfo.txt.tns",sizeof(filename)) != 0
+		|| file_info.crc != p->pkginfo_crc || file_info.uncompressed_size != p->pkginfo_size)
+	{
+		freePackageInfo(p);
+		return NULL;
+	}
+	return p;
+}
+
+// Takes the pkginfo of an open package from its record, or unzips and parses
+// pkginfo.txt.tns when it has none
+pkginfo* readPackageInfo(unzFile uf)
+{
+	int phase = profileEnter(PHASE_PKGINFO);
+	pkginfo* p = readPackageRecord(uf);
+	if(p != NULL)
+	{
+		debug("reading package record...");
+		success(" done (%u entries, %u bytes)\n",p->entry_count,p->installed_size);
+	}
+	else
+	{
+		debug("unzipping package info...");
+		void* buffer = unzGetFileContent(uf,"pkginfo.txt.tns");
+		if(buffer == NULL)
+		{
+			fail(" failed\n");
+			profileEnter(phase);
+			return NULL;
+		}
+		success(" done\n");
+		
+		debug("parsing package info...");
+		p = parsePackageInfo(buffer);
+		free(buffer);
+		if(p == NULL)
+		{
+			fail(" failed\n");
+			profileEnter(phase);
+			return NULL;
+		}
+		success(" done\n");
+	}
+	
+	// Every package path is built from the name, see isValidPackageName
+	if(!isValidPackageName(p->name))
+	{
+		fail("%s is not a valid package name\n",p->name);
+		freePackageInfo(p);
+		profileEnter(phase);
+		return NULL;
+	}
+	
+	debug("Package %s\n",p->name);
+	debug("Version: %s\n",p->version);
+	debug("Timestamp: %d\n",p->timestamp);
+	profileEnter(phase);
+	return p;
+}
+
+// Installs the files, extensions and links of a package the user agreed to install
+// and updates its index entry in memory, saving the index is left to the caller.
+// Each step is profiled as its phase, the caller picks the phase that follows.
+int installPackageFiles(unzFile uf, pkginfo* p, pkgindex* index, installstats* stats)
+{
+	char full_path[50];
+	sprintf(full_path,"%s/%s",PACSPIRE_ROOT,p->name);
+	manifest* old_manifest = NULL;
+	if(findIndexEntry(index,p->name) != NULL)
+	{
+		profileEnter(PHASE_MANIFEST);
+		debug("Loading file manifest of the installed version...");
+		old_manifest = loadManifest(p->name);
+		if(old_manifest != NULL)
+		{
+			success(" done (%d entries)\n",old_manifest->count);
+		}
+		else
+		{
+			warn(" not found, replacing the whole directory\n");
+		}
+	}
+	
+	char staging_path[60];
+	sprintf(staging_path,"%s.new",full_path);
+	profileEnter(PHASE_MKDIR);
+	removeDir(staging_path); // left over from an interrupted installation
+	
+	debug("Creating staging directory %s...",staging_path);
+	if(fsMkdir(staging_path) == -1)
+	{
+		fail(" failed\n");
+		if(old_manifest != NULL)
+			freeManifest(old_manifest);
+		return INSTALLATION_FAILED;
+	}
+	success(" done\n");
+	
+	unz_global_info global_info;
+	unzGetGlobalInfo(uf,&global_info);
+	manifest* new_manifest = createManifest(global_info.number_entry);
+	char* extract_buffer = malloc(EXTRACT_BUFFER_SIZE);
+	if(new_manifest == NULL || extract_buffer == NULL)
+	{
+		fail("Could not allocate extraction buffers\n");
+		free(extract_buffer);
+		if(new_manifest != NULL)
+			freeManifest(new_manifest);
+		if(old_manifest != NULL)
+			freeManifest(old_manifest);
+		removeDir(staging_path);
+		return INSTALLATION_FAILED;
+	}
+	
+	memset(stats,0,sizeof(installstats));
+	unsigned int crc_start = profileTime(PHASE_CRC);
+	profileEnter(PHASE_ENTRIES);
+	int result = extractPackage(uf,staging_path,old_manifest,new_manifest,extract_buffer,stats);
+	stats->crc_time = profileTime(PHASE_CRC) - crc_start;
+	free(extract_buffer);
+	if(result == 0 && addPackageRecords(new_manifest,p) == -1)
+	{
+		fail("Could not record the extensions and links in the manifest\n");
+		result = -1;
+	}
+	if(result == 0)
+	{
+		sortManifest(new_manifest);
+		
+		profileEnter(PHASE_COMMIT);
+		debug("Moving staged files into place...");
+		if(old_manifest != NULL)
+			result = commitStagedFiles(staging_path,full_path,new_manifest);
+		else
+			result = commitStagedDirectory(staging_path,full_path);
+		
+		if(result == 0)
+		{
+			success(" done\n");
+		}
+		else
+		{
+			fail(" failed\n");
+		}
+		
+		// The new files are in place and there is no going back to the old version
+		// from here, what it leaves behind does not make the installation fail
+		if(result == 0 && old_manifest != NULL && removeManifestEntries(full_path,old_manifest,new_manifest,stats) == -1)
+			warn("Some files of the old version are left in %s\n",full_path);
+	}
+	else
+	{
+		profileEnter(PHASE_COMMIT);
+		debug("Cleaning up staging directory...");
+		unsigned int start = getMilliseconds();
+		int removed = removeDir(staging_path);
+		success(" done (%d entries in %u ms)\n",removed,getMilliseconds() - start);
+	}
+	if(result == 0)
+	{
+		profileEnter(PHASE_MANIFEST);
+		debug("Writing file manifest...");
+		if(saveManifest(p->name,new_manifest) == 0)
+		{
+			success(" done\n");
+		}
+		else
+		{
+			// The old manifest no longer describes the files, without one the
+			// next upgrade replaces the whole directory
+			char manifest_path[50];
+			sprintf(manifest_path,"%s/%s.man.tns",PACSPIRE_ROOT,p->name);
+			fsUnlink(manifest_path);
+			warn(" failed, removed the old one\n");
+		}
+	}
+	freeManifest(new_manifest);
+	if(old_manifest != NULL)
+		freeManifest(old_manifest);
+	if(result == -1)
+		return INSTALLATION_FAILED;
+	
+	debug("%d files written, %d unchanged, %d removed, %d directories created\n",stats->files_written,stats->files_unchanged,stats->entries_removed,stats->dirs_created);
+	debug("CRC verification: %lu bytes in %u us\n",stats->bytes_written,stats->crc_time);
+	debug("Peak extraction heap: %d bytes (largest entry %lu bytes)\n",EXTRACT_BUFFER_SIZE + session_arena.peak,stats->largest_entry);
+	debug("Session arena: %u blocks from the system heap\n",session_arena.system_allocs);
+	if(package_cache.base_reads > 0)
+		debug("Package file: %lu reads, %lu seeks\n",package_cache.base_reads,package_cache.base_seeks);
+	
+	int i;
+	profileEnter(PHASE_EXTENSIONS);
+	for(i = 0; i < p->ext_count; i++)
+		registerExtension(p->extensions[i].extension,p->extensions[i].program);
+	
+	profileEnter(PHASE_LINKS);
+	for(i = 0; i < p->link_count; i++)
+	{
+		debug("Creating link (%s.lnk.tns -> %s)...",p->links[i].name,p->links[i].program);
+		char link_path[60];
+		char exec_path[70]; // the package directory, '/' and a program of up to 14 characters
+		
+		sprintf(link_path,"/documents/%s.lnk.tns",p->links[i].name);
+		sprintf(exec_path,"%s/%s",full_path,p->links[i].program);
+		if(writeFileContent(link_path,exec_path,strlen(exec_path)) == -1)
+		{
+			// Like the extensions, the files are installed and the index has to say so
+			warn(" failed\n");
+		}
+		else
+		{
+			success(" done\n");
+		}
+	}
+	
+	indexentry entry;
+	memset(&entry,0,sizeof(indexentry));
+	strcpy(entry.name,p->name);
+	strcpy(entry.version,p->version);
+	entry.timestamp = p->timestamp;
+	entry.file_count = stats->file_count;
+	entry.size = stats->installed_size;
+	joinExtensions(entry.extensions,sizeof(entry.extensions),p);
+	profileEnter(PHASE_INDEX);
+	if(updateIndexEntry(index,&entry) == -1)
+	{
+		fail("Could not add %s to the package index\n",p->name);
+		return INSTALLATION_FAILED;
+	}
+	return INSTALLATION_SUCCESS;
+}
+
+int installPackage(char* file)
+{
+	unzFile uf = NULL;
+	
+	debug("opening package...");
+	uf = openPackage(file);
+	if(uf == NULL)
+	{
+		fail(" failed\n");
+		return INSTALLATION_FAILED;
+	}
+	success(" done\n");
+	
+	pkginfo* p = readPackageInfo(uf);
+	if(p == NULL)
+	{
+		unzClose(uf);
+		return INSTALLATION_FAILED;
+	}
+	
+	profileEnter(PHASE_INDEX);
+	debug("loading package index...");
+	pkgindex* index = loadIndex();
+	profileEnter(PHASE_OTHER);
+	if(index == NULL)
+	{
+		fail(" failed\n");
+		freePackageInfo(p);
+		unzClose(uf);
+		return INSTALLATION_FAILED;
+	}
+	success(" done (%d packages)\n",index->count);
+	
+	debug("checking if package is already installed...");
+	indexentry* installed = findIndexEntry(index,p->name);
+	if(installed != NULL)
+	{
+		warn(" yes\n");
+		
+		debug("checking if the package is newer than the installed version...");
+		char message[200];
+		if(p->timestamp <= installed->timestamp)
+		{
+			warn(" no\n");
+			sprintf(message,"You already have a newer or the same version of %s installed.",p->name);
+			if(askUser(message,"OK","Force installation") == 1)
+			{
+				fail("Installation aborted\n");
+				freeIndex(index);
+				freePackageInfo(p);
+				unzClose(uf);
+				return INSTALLATION_ABORTED;
+			}
+		}
+		else
+		{
+			success(" yes\n");
+			sprintf(message,"Do you want to update %s (%s -> %s)?",p->name,installed->version,p->version);
+			if(askUser(message,"Yes","No") == 2)
+			{
+				fail("Installation aborted by user\n");
+				freeIndex(index);
+				freePackageInfo(p);
+				unzClose(uf);
+				return INSTALLATION_ABORTED;
+			}
+		}
+	}
+	else
+	{
+		success(" no\n");
+		char message[50];
+		sprintf(message,"Do you want to install %s?",p->name);
+		if(askUser(message,"Install","Cancel") == 2)
+		{
+			fail("Installation aborted by user\n");
+			freeIndex(index);
+			freePackageInfo(p);
 			unzClose(uf);
-			return INSTALLATION_FAILED;
+			return INSTALLATION_ABORTED;
+		}
+	}
+	
+	installstats stats;
+	int result = installPackageFiles(uf,p,index,&stats);
+	if(result == INSTALLATION_SUCCESS)
+	{
+		profileEnter(PHASE_INDEX);
+		debug("Updating package index...");
+		if(saveIndex(index) == -1)
+		{
+			fail(" failed\n");
+			result = INSTALLATION_FAILED;
+		}
+		else
+		{
+			success(" done\n");
+		}
+	}
+	profileEnter(PHASE_OTHER);
+	
+	char label[40];
+	sprintf(label,"%s %s",p->name,p->version);
+	profileAppend(STATS_FILE,label,result == INSTALLATION_SUCCESS ? "ok" : "failed",__DATE__ " " __TIME__);
+	freeIndex(index);
+	freePackageInfo(p);
+	unzClose(uf);
+	return result;
+}
+
+enum
+{
+	BATCH_INSTALL,
+	BATCH_UPDATE,
+	BATCH_SKIP, // same or newer version installed, or listed twice
+	BATCH_UNREADABLE
+};
+
+// Package of a batch, see installBatch
+typedef struct
+{
+	char file[100];
+	pkginfo* p; // NULL if the package could not be read
+	int action;
+	int result;
+	unsigned int time;
+	unsigned long bytes_written;
+} batchentry;
+
+typedef struct
+{
+	int count;
+	int capacity;
+	batchentry* entries;
+} batch;
+
+int addBatchPackage(batch* b, const char* file)
+{
+	if(strlen(file) >= sizeof(b->entries[0].file))
+		return -1;
+	if(b->count == b->capacity)
+	{
+		int capacity = b->capacity > 0 ? 2*b->capacity : 16;
+		batchentry* entries = realloc(b->entries,capacity*sizeof(batchentry));
+		if(entries == NULL)
+			return -1;
+		b->entries = entries;
+		b->capacity = capacity;
+	}
+	batchentry* e = &b->entries[b->count++];
+	memset(e,0,sizeof(batchentry));
+	strcpy(e->file,file);
+	return 0;
+}
+
+int compareBatchEntries(const void* a, const void* b)
+{
+	return strcmp(((const batchentry*)a)->file,((const batchentry*)b)->file);
+}
+
+// Adds every package in folder in alphabetical order, returns -1 if it is not a folder
+int addBatchFolder(batch* b, const char* folder)
+{
+	DIR* dir = fsOpenDir(folder);
+	if(dir == NULL)
+		return -1;
+	
+	int first = b->count;
+	struct dirent* entry;
+	while((entry = readdir(dir)) != 0)
+	{
+		int len = strlen(entry->d_name);
+		if(len <= 8 || strcmp(entry->d_name + len - 8,".pcs.tns") != 0)
+			continue;
+		
+		char path[100];
+		if(strlen(folder) + len + 2 > sizeof(path))
+			continue;
+		sprintf(path,"%s/%s",folder,entry->d_name);
+		if(addBatchPackage(b,path) == -1)
+		{
+			closedir(dir);
+			return -1;
+		}
+	}
+	closedir(dir);
+	
+	qsort(&b->entries[first],b->count - first,sizeof(batchentry),compareBatchEntries);
+	return 0;
+}
+
+// Reads a list of packages and folders, one per line and relative to the folder
+// of the list unless they start with a slash; empty lines and # comments are skipped
+int readBatchList(batch* b, const char* list_file)
+{
+	char* content = getFileContent(list_file);
+	if(content == NULL)
+		return -1;
+	
+	char base[100];
+	if(snprintf(base,sizeof(base),"%s",list_file) >= (int)sizeof(base))
+	{
+		free(content);
+		return -1;
+	}
+	char* slash = strrchr(base,'/');
+	if(slash != NULL)
+		*slash = '\0';
+	else
+		strcpy(base,".");
+	
+	char* line = content;
+	while(*line != '\0')
+	{
+		int len = strcspn(line,"\r\n");
+		char* next = line + len + strspn(line + len,"\r\n");
+		while(len > 0 && (line[len-1] == ' ' || line[len-1] == '\t'))
+			len--;
+		line[len] = '\0';
+		
+		if(len > 0 && line[0] != '#')
+		{
+			char path[100];
+			int path_len;
+			if(line[0] == '/')
+				path_len = snprintf(path,sizeof(path),"%s",line);
+			else
+				path_len = snprintf(path,sizeof(path),"%s/%s",base,line);
+			if(path_len >= (int)sizeof(path))
+			{
+				free(content);
+				return -1;
+			}
+			
+			if(addBatchFolder(b,path) == -1 && addBatchPackage(b,path) == -1)
+			{
+				free(content);
+				return -1;
+			}
 		}
+		line = next;
 	}
-	success(" done\n");
 	
-	debug("Going to first file in zip...");
-	if(unzGoToFirstFile(uf) != UNZ_OK)
+	free(content);
+	return 0;
+}
+
+// Reads the pkginfo of every package of the batch and decides what to do with it
+void prepareBatch(batch* b, pkgindex* index)
+{
+	int i;
+	for(i = 0; i < b->count; i++)
 	{
-		fail(" failed\n");
-		freePackageInfo(p);
+		batchentry* e = &b->entries[i];
+		debug("reading %s...",e->file);
+		unzFile uf = openPackage(e->file);
+		if(uf == NULL)
+		{
+			fail(" failed\n");
+			e->action = BATCH_UNREADABLE;
+			continue;
+		}
+		success(" done\n");
+		e->p = readPackageInfo(uf);
 		unzClose(uf);
+		if(e->p == NULL)
+		{
+			e->action = BATCH_UNREADABLE;
+			continue;
+		}
+		
+		int j;
+		for(j = 0; j < i; j++)
+			if(b->entries[j].p != NULL && strcmp(b->entries[j].p->name,e->p->name) == 0)
+				break;
+		indexentry* installed = findIndexEntry(index,e->p->name);
+		if(j < i)
+		{
+			warn("%s is already in the batch, skipping it\n",e->p->name);
+			e->action = BATCH_SKIP;
+		}
+		else if(installed == NULL)
+			e->action = BATCH_INSTALL;
+		else if(e->p->timestamp > installed->timestamp)
+			e->action = BATCH_UPDATE;
+		else
+		{
+			warn("%s %s is already installed, skipping it\n",e->p->name,installed->version);
+			e->action = BATCH_SKIP;
+		}
+	}
+}
+
+void freeBatch(batch* b)
+{
+	int i;
+	for(i = 0; i < b->count; i++)
+		if(b->entries[i].p != NULL)
+			freePackageInfo(b->entries[i].p);
+	free(b->entries);
+}
+
+void printBatchSummary(batch* b, unsigned int time)
+{
+	static const char* const actions[] = {"installed","updated","skipped","unreadable"};
+	int installed = 0;
+	int failed = 0;
+	int skipped = 0;
+	int i;
+	debug("\n%-20s %-10s %8s %10s\n","package","result","ms","written");
+	for(i = 0; i < b->count; i++)
+	{
+		batchentry* e = &b->entries[i];
+		const char* name = e->p != NULL ? e->p->name : strrchr(e->file,'/') != NULL ? strrchr(e->file,'/') + 1 : e->file;
+		if(e->action == BATCH_SKIP)
+		{
+			debug("%-20.20s %s\n",name,actions[e->action]);
+			skipped++;
+		}
+		else if(e->action == BATCH_UNREADABLE || e->result != INSTALLATION_SUCCESS)
+		{
+			fail("%-20.20s %-10s",name,e->action == BATCH_UNREADABLE ? actions[e->action] : "failed");
+			debug(" %8u\n",e->time);
+			failed++;
+		}
+		else
+		{
+			debug("%-20.20s %-10s %8u %10lu\n",name,actions[e->action],e->time,e->bytes_written);
+			installed++;
+		}
+	}
+	debug("%d installed, %d skipped, %d failed in %u ms\n",installed,skipped,failed,time);
+}
+
+// Installs every package of a list file or folder with a single confirmation,
+// sharing the package index, ndless.cfg and the allocators between them
+int installBatch(const char* path)
+{
+	unsigned int start = getMilliseconds();
+	batch b;
+	b.count = 0;
+	b.capacity = 0;
+	b.entries = NULL;
+	
+	debug("collecting packages...");
+	if(addBatchFolder(&b,path) == -1 && readBatchList(&b,path) == -1)
+	{
+		fail(" failed\n");
+		freeBatch(&b);
 		return INSTALLATION_FAILED;
 	}
-	success(" done\n");
+	success(" done (%d packages)\n",b.count);
 	
-	do
+	profileEnter(PHASE_INDEX);
+	debug("loading package index...");
+	pkgindex* index = loadIndex();
+	profileEnter(PHASE_OTHER);
+	if(index == NULL)
 	{
-		char filename[50];
-		unz_file_info file_info;
-		unzGetCurrentFileInfo(uf,&file_info,filename,50,NULL,0,NULL,0);
+		fail(" failed\n");
+		freeBatch(&b);
+		return INSTALLATION_FAILED;
+	}
+	success(" done (%d packages)\n",index->count);
+	
+	prepareBatch(&b,index);
+	int counts[4] = {0,0,0,0};
+	int i;
+	for(i = 0; i < b.count; i++)
+		counts[b.entries[i].action]++;
+	
+	char message[200];
+	if(counts[BATCH_INSTALL] + counts[BATCH_UPDATE] == 0)
+	{
+		sprintf(message,"There is nothing to install: %d packages are up to date, %d cannot be read.",counts[BATCH_SKIP],counts[BATCH_UNREADABLE]);
+		showMessage(message);
+		freeIndex(index);
+		freeBatch(&b);
+		return INSTALLATION_ABORTED;
+	}
+	sprintf(message,"Do you want to install %d and update %d packages?",counts[BATCH_INSTALL],counts[BATCH_UPDATE]);
+	if(counts[BATCH_SKIP] + counts[BATCH_UNREADABLE] > 0)
+		sprintf(message + strlen(message),"\n%d are up to date and %d cannot be read, they are skipped.",counts[BATCH_SKIP],counts[BATCH_UNREADABLE]);
+	if(askUser(message,"Install","Cancel") == 2)
+	{
+		fail("Installation aborted by user\n");
+		freeIndex(index);
+		freeBatch(&b);
+		return INSTALLATION_ABORTED;
+	}
+	
+	int failed = counts[BATCH_UNREADABLE];
+	int changed = 0;
+	for(i = 0; i < b.count; i++)
+	{
+		batchentry* e = &b.entries[i];
+		if(e->action != BATCH_INSTALL && e->action != BATCH_UPDATE)
+			continue;
 		
-		if(filename[strlen(filename)-1] == '/')
+		unsigned int package_start = getMilliseconds();
+		debug("\ninstalling %s %s from %s...",e->p->name,e->p->version,e->file);
+		unzFile uf = openPackage(e->file);
+		if(uf == NULL)
+		{
+			fail(" failed\n");
+			e->result = INSTALLATION_FAILED;
+		}
+		else
 		{
-			debug("Creating directory %s...",filename);
-			char dir_path[60];
-			sprintf(dir_path,"%s/%s",full_path,filename);
-			if(createDir(dir_path) == -1)
-			{
-				fail(" failed\n");
-				freePackageInfo(p);
-				unzClose(uf);
-				return INSTALLATION_FAILED;
-			}
 			success(" done\n");
+			installstats stats;
+			e->result = installPackageFiles(uf,e->p,index,&stats);
+			e->bytes_written = stats.bytes_written;
+			profileEnter(PHASE_OTHER);
+			unzClose(uf);
+		}
+		e->time = getMilliseconds() - package_start;
+		
+		if(e->result == INSTALLATION_SUCCESS)
+			changed++;
+		else
+			failed++;
+	}
+	
+	// The index is written once for the whole batch, a package whose entry is
+	// lost by an interruption is found again by its next installation
+	int result = failed > 0 ? INSTALLATION_FAILED : INSTALLATION_SUCCESS;
+	if(changed > 0)
+	{
+		profileEnter(PHASE_INDEX);
+		debug("Updating package index...");
+		if(saveIndex(index) == -1)
+		{
+			fail(" failed\n");
+			result = INSTALLATION_FAILED;
 		}
 		else
 		{
-			debug("Inflating file %s...",filename);
-			char* buffer = unzGetCurrentFileContent(uf);
-			if(buffer == NULL)
+			success(" done\n");
+		}
+		profileEnter(PHASE_OTHER);
+	}
+	
+	printBatchSummary(&b,getMilliseconds() - start);
+	char label[120];
+	snprintf(label,sizeof(label),"batch %s (%d packages)",path,changed);
+	profileAppend(STATS_FILE,label,result == INSTALLATION_SUCCESS ? "ok" : "failed",__DATE__ " " __TIME__);
+	freeIndex(index);
+	freeBatch(&b);
+	return result;
+}
+
+enum
+{
+	REMOVAL_SUCCESS,
+	REMOVAL_FAILED,
+	REMOVAL_ABORTED
+};
+
+// Without a manifest the launchers and extensions can only be found through
+// the pkginfo the package left in its directory, which is then deleted as a whole
+int removeUnlistedPackage(const char* full_path)
+{
+	char path[60];
+	sprintf(path,"%s/pkginfo.txt.tns",full_path);
+	char* buffer = getFileContent(path);
+	if(buffer != NULL)
+	{
+		pkginfo* p = parsePackageInfo(buffer);
+		free(buffer);
+		if(p != NULL)
+		{
+			int i;
+			for(i = 0; i < p->ext_count; i++)
 			{
-				fail(" failed\n");
-				freePackageInfo(p);
-				unzClose(uf);
-				return INSTALLATION_FAILED;
+				debug("Unregistering extension %s...",p->extensions[i].extension);
+				sprintf(path,"%s=%s",p->extensions[i].extension,p->extensions[i].program);
+				if(unregisterExtension(path) == -1)
+				{
+					warn(" failed\n");
+				}
+				else
+				{
+					success(" done\n");
+				}
 			}
-			success(" done\n");
-			
-			debug("Writing content to file...");
-			char file_path[60];
-			sprintf(file_path,"%s/%s",full_path,filename);
-			if(writeFileContent(file_path,buffer,file_info.uncompressed_size) == -1)
+			for(i = 0; i < p->link_count; i++)
 			{
-				fail(" failed\n");
-				free(buffer);
-				freePackageInfo(p);
-				unzClose(uf);
-				return INSTALLATION_FAILED;
+				debug("Removing link %s.lnk.tns...",p->links[i].name);
+				sprintf(path,"/documents/%s.lnk.tns",p->links[i].name);
+				fsUnlink(path);
+				success(" done\n");
 			}
-			success(" done\n");
-			
-			free(buffer);
+			freePackageInfo(p);
 		}
 	}
-	while(unzGoToNextFile(uf) == UNZ_OK);
 	
-	if(p->ext_count > 0)
+	debug("Removing %s...",full_path);
+	unsigned int start = getMilliseconds();
+	int removed = removeDir(full_path);
+	if(removed == -1)
 	{
-		int i;
-		for(i = 0; i < p->ext_count; i++)
+		fail(" failed\n");
+		return -1;
+	}
+	success(" done (%d entries in %u ms)\n",removed,getMilliseconds() - start);
+	return 0;
+}
+
+int removePackage(const char* name)
+{
+	char message[100];
+	if(!isValidPackageName(name))
+	{
+		showMessage("This is not a valid package name.");
+		return REMOVAL_ABORTED;
+	}
+	
+	debug("loading package index...");
+	pkgindex* index = loadIndex();
+	if(index == NULL)
+	{
+		fail(" failed\n");
+		return REMOVAL_FAILED;
+	}
+	success(" done (%d packages)\n",index->count);
+	
+	char full_path[50];
+	sprintf(full_path,"%s/%s",PACSPIRE_ROOT,name);
+	struct stat s;
+	if(findIndexEntry(index,name) == NULL && fsStat(full_path,&s) == -1)
+	{
+		sprintf(message,"%s is not installed.",name);
+		showMessage(message);
+		freeIndex(index);
+		return REMOVAL_ABORTED;
+	}
+	
+	sprintf(message,"Do you want to remove %s?",name);
+	if(askUser(message,"Remove","Cancel") == 2)
+	{
+		freeIndex(index);
+		return REMOVAL_ABORTED;
+	}
+	
+	char manifest_path[50];
+	sprintf(manifest_path,"%s/%s.man.tns",PACSPIRE_ROOT,name);
+	manifest* m = loadManifest(name);
+	int result;
+	if(m != NULL)
+	{
+		installstats stats;
+		memset(&stats,0,sizeof(installstats));
+		result = removeManifestEntries(full_path,m,NULL,&stats);
+		freeManifest(m);
+		
+		if(result == 0)
 		{
-			debug("Registering extension %s for %s...",p->extensions[i].extension,p->extensions[i].program);
-			cfg_register_fileext(p->extensions[i].extension,p->extensions[i].program);
-			success(" done\n");
+			debug("Removing %s...",full_path);
+			if(fsRmdir(full_path) == -1 && errno != 2)
+			{
+				// Files the package created at runtime are not in the manifest
+				warn(" not empty, left in place\n");
+			}
+			else
+			{
+				success(" done\n");
+			}
+			debug("%d entries removed\n",stats.entries_removed);
 		}
 	}
+	else
+	{
+		warn("File manifest of %s not found, removing the whole directory\n",name);
+		result = removeUnlistedPackage(full_path);
+	}
+	
+	if(result == -1)
+	{
+		freeIndex(index);
+		return REMOVAL_FAILED;
+	}
+	fsUnlink(manifest_path);
+	
+	debug("Updating package index...");
+	removeIndexEntry(index,name);
+	if(saveIndex(index) == -1)
+	{
+		fail(" failed\n");
+		freeIndex(index);
+		return REMOVAL_FAILED;
+	}
+	success(" done\n");
 	
-	if(p->link_count > 0)
+	freeIndex(index);
+	return REMOVAL_SUCCESS;
+}
+
+// Formats a UNIX timestamp as YYYY-MM-DD
+void formatDate(char* dest, unsigned int timestamp)
+{
+	// Civil date from a day number, see http://howardhinnant.github.io/date_algorithms.html
+	int z = timestamp / 86400 + 719468;
+	int era = z / 146097;
+	int doe = z - era * 146097;
+	int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	int mp = (5 * doy + 2) / 153;
+	int day = doy - (153 * mp + 2) / 5 + 1;
+	int month = mp < 10 ? mp + 3 : mp - 9;
+	int year = yoe + era * 400 + (month <= 2);
+	sprintf(dest,"%04d-%02d-%02d",year,month,day);
+}
+
+char lowerCase(char c)
+{
+	return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+// Case insensitive substring search
+int matchesFilter(const char* s, const char* filter)
+{
+	if(filter[0] == '\0')
+		return 1;
+	
+	for(; *s != '\0'; s++)
 	{
 		int i;
-		for(i = 0; i < p->link_count; i++)
+		for(i = 0; filter[i] != '\0' && lowerCase(s[i]) == lowerCase(filter[i]); i++);
+		if(filter[i] == '\0')
+			return 1;
+	}
+	return 0;
+}
+
+int compareEntriesBySize(const void* a, const void* b)
+{
+	const indexentry* x = *(const indexentry**)a;
+	const indexentry* y = *(const indexentry**)b;
+	if(x->size != y->size)
+		return x->size < y->size ? 1 : -1;
+	return strcmp(x->name,y->name);
+}
+
+int compareEntriesByDate(const void* a, const void* b)
+{
+	const indexentry* x = *(const indexentry**)a;
+	const indexentry* y = *(const indexentry**)b;
+	if(x->timestamp != y->timestamp)
+		return x->timestamp < y->timestamp ? 1 : -1;
+	return strcmp(x->name,y->name);
+}
+
+// The buttons of the sort order dialog
+enum
+{
+	SORT_BY_NAME = 1,
+	SORT_BY_SIZE,
+	SORT_BY_DATE
+};
+
+// Shows the installed packages from the index, sorted and filtered in memory
+void listPackages()
+{
+	pkgindex* index = loadIndex();
+	if(index == NULL)
+	{
+		showMessage("The package index could not be loaded.");
+		return;
+	}
+	if(index->count == 0)
+	{
+		showMessage("No packages are installed.");
+		freeIndex(index);
+		return;
+	}
+	
+	int order = showDialog("Sort the installed packages by","Name","Size","Date");
+	char* filter = NULL;
+	if(askInput("Only show packages whose name or extensions contain (leave empty for all):",&filter) == -1)
+		filter = NULL;
+	
+	indexentry** shown = malloc(index->count*sizeof(indexentry*));
+	if(shown == NULL)
+	{
+		free(filter);
+		freeIndex(index);
+		return;
+	}
+	
+	int count = 0;
+	int i;
+	for(i = 0; i < index->count; i++)
+	{
+		if(filter == NULL || matchesFilter(index->entries[i].name,filter) || matchesFilter(index->entries[i].extensions,filter))
+			shown[count++] = &index->entries[i];
+	}
+	
+	// The index itself is sorted by name
+	if(order == SORT_BY_SIZE)
+		qsort(shown,count,sizeof(indexentry*),compareEntriesBySize);
+	else if(order == SORT_BY_DATE)
+		qsort(shown,count,sizeof(indexentry*),compareEntriesByDate);
+	
+	consoleClear();
+	consolePrintf("%d of %d installed packages\n",count,index->count);
+	int lines = 1;
+	for(i = 0; i < count; i++)
+	{
+		// Every package takes two lines, page before the screen scrolls
+		if(lines + 2 >= CONSOLE_ROWS)
 		{
-			debug("Creating link (%s.lnk.tns -> %s)...",p->links[i].name,p->links[i].program);
-			char link_path[60];
-			char exec_path[60];
-			
-			sprintf(link_path,"/documents/%s.lnk.tns",p->links[i].name);
-			sprintf(exec_path,"%s/%s",full_path,p->links[i].program);
-			if(writeFileContent(link_path,exec_path,strlen(exec_path)) == -1)
-			{
-				fail(" failed\n");
-				freePackageInfo(p);
-				unzClose(uf);
-				return INSTALLATION_FAILED;
-			}
-			success(" done\n");
+			consolePrintf("Press any key for more...\n");
+			consoleFlush();
+			waitKey();
+			lines = 0;
 		}
+		
+		char date[11];
+		formatDate(date,shown[i]->timestamp);
+		consolePrintf("%-20s %-10s %s\n",shown[i]->name,shown[i]->version,date);
+		consolePrintf("  %u files, %u KB%s%s\n",shown[i]->file_count,(shown[i]->size + 1023) / 1024,
+			shown[i]->extensions[0] != '\0' ? ", ext: " : "",shown[i]->extensions);
+		lines += 2;
 	}
 	
-	freePackageInfo(p);
-	unzClose(uf);
-	return INSTALLATION_SUCCESS;
+	consolePrintf("Press any key to exit...");
+	consoleFlush();
+	waitKey();
+	
+	free(shown);
+	free(filter);
+	freeIndex(index);
 }
 
-int main(int argc, char** argv)
+// Installs a package, or the packages of a list file or folder, in one allocator session
+void installCommand(char* target, int batch_mode)
+{
+	int result;
+	logStartFile(LOG_FILE);
+	unzSetAllocFunctions(arenaAlloc,arenaFree,&session_arena);
+	if(batch_mode)
+	{
+		debug("attempting to install the packages of %s\n",target);
+		result = installBatch(target);
+	}
+	else
+	{
+		debug("attempting to install package %s\n",target);
+		result = installPackage(target);
+	}
+	unzSetAllocFunctions(NULL,NULL,NULL);
+	arenaReset(&session_arena);
+	forgetNdlessConfig();
+	logFlush();
+	
+	switch(result)
+	{
+		case INSTALLATION_ABORTED:
+			break;
+		
+		case INSTALLATION_SUCCESS:
+			showMessage(batch_mode ? "All packages were installed." : "The installation was successful.");
+			break;
+			
+		case INSTALLATION_FAILED:
+			if(showDialog("The installation failed. Read the log for more details.","OK","View Log",NULL) == 2)
+				logReplay();
+			break;
+	}
+}
+
+// Removes the named package, or asks for the name if there is none
+void removeCommand(const char* name)
 {
-	assert_ndless_rev(877);
+	char* input = NULL;
+	if(name == NULL)
+	{
+		if(askInput("Name of the package to remove:",&input) == -1)
+			return;
+		name = input;
+	}
 	
-	nio_console c;
-	#if DEBUG_CONSOLE == 1
-	clrscr();
-	nio_init(&c,NIO_MAX_COLS,NIO_MAX_ROWS,0,0,NIO_COLOR_WHITE,NIO_COLOR_BLACK,TRUE);
-	#else
-	nio_init(&c,NIO_MAX_COLS,NIO_MAX_ROWS,0,0,NIO_COLOR_WHITE,NIO_COLOR_BLACK,FALSE);
-	#endif
-	nio_set_default(&c);
+	logStartFile(LOG_FILE);
+	debug("attempting to remove package %s\n",name);
+	int result = removePackage(name);
+	logFlush();
+	switch(result)
+	{
+		case REMOVAL_ABORTED:
+			break;
+		
+		case REMOVAL_SUCCESS:
+			showMessage("The package was removed.");
+			break;
+			
+		case REMOVAL_FAILED:
+			if(showDialog("The removal failed. Read the log for more details.","OK","View Log",NULL) == 2)
+				logReplay();
+			break;
+	}
+	free(input);
+}
+
+int main(int argc, char** argv)
+{
+	platformInit();
+	initTimer();
+	profileReset();
 	
 	debug("pacspire (%s %s)\n",__DATE__,__TIME__);
 	
+	// -q only shows problems, -v every file
+	if(argc > 1 && (strcmp(argv[1],"-q") == 0 || strcmp(argv[1],"-v") == 0))
+	{
+		logSetLevel(argv[1][1] == 'q' ? LOG_QUIET : LOG_VERBOSE);
+		argv++;
+		argc--;
+	}
+	
 	if(argc > 1)
 	{
 		if(strstr(argv[1],".pcs.tns") != NULL)
 		{
-			debug("attempting to install package %s\n",argv[1]);
-			switch(installPackage(argv[1]))
-			{
-				case INSTALLATION_ABORTED:
-					break;
-				
-				case INSTALLATION_SUCCESS:
-					show_msgbox("pacspire","The installation was successful.");
-					break;
-					
-				case INSTALLATION_FAILED:
-					if(show_msgbox_2b("pacspire","The installation failed. Read the log for more details.","OK","View Log") == 2)
-					{
-						clrscr();
-						debug("Press any key to exit...");
-						nio_fflush(&c);
-						wait_key_pressed();
-					}
-					break;
-			}
+			installCommand(argv[1],0);
+		}
+		else if(strstr(argv[1],".pcb.tns") != NULL)
+		{
+			installCommand(argv[1],1);
+		}
+		else if(strcmp(argv[1],"batch") == 0 && argc > 2)
+		{
+			installCommand(argv[2],1);
+		}
+		else if(strcmp(argv[1],"list") == 0)
+		{
+			listPackages();
+		}
+		else if(strcmp(argv[1],"remove") == 0)
+		{
+			removeCommand(argc > 2 ? argv[2] : NULL);
 		}
 		else if(strstr(argv[1],".lnk.tns") != NULL)
 		{
 			char* exec_path = getFileContent(argv[1]);
 			debug("passing control to %s\n",exec_path);
-			int ret = nl_exec(exec_path,0,NULL);
+			logFlush();
+			int ret = runProgram(exec_path);
 			debug("%s returned with status code %d\n",exec_path,ret);
-			wait_key_pressed();
+			logFlush();
+			waitKey();
 		}
 	}
 	else
@@ -598,16 +2477,31 @@ int main(int argc, char** argv)
 		success(" done\n");
 		
 		debug("registering .pcs extension...");
-		cfg_register_fileext("pcs","pacspire");
+		registerFileExtension("pcs","pacspire");
 		success(" done\n");
 		
 		debug("registering .lnk extension...");
-		cfg_register_fileext("lnk","pacspire");
+		registerFileExtension("lnk","pacspire");
+		success(" done\n");
+		
+		debug("registering .pcb extension...");
+		registerFileExtension("pcb","pacspire");
 		success(" done\n");
-		show_msgbox("pacspire","pacspire has been installed. Click on a package to install it.");
+		logFlush();
+		switch(showDialog("pacspire has been installed. Click on a package to install it.","OK","List packages","Remove package"))
+		{
+			case 2:
+				listPackages();
+				break;
+			
+			case 3:
+				removeCommand(NULL);
+				break;
+		}
 	}
 	
-	nio_free(&c);
-	refresh_osscr();
+	logClose();
+	restoreTimer();
+	platformExit();
 	return 0;
 }
\ No newline at end of file
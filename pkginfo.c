@@ -0,0 +1,361 @@
+#include <os.h>
+#include "pkginfo.h"
+
+enum
+{
+	KEY_UNKNOWN,
+	KEY_NAME,
+	KEY_VERSION,
+	KEY_TIMESTAMP,
+	KEY_EXT_NAME,
+	KEY_EXT_PROG,
+	KEY_LINK_NAME,
+	KEY_LINK_PROG
+};
+
+// Maps a key to its KEY_ value with a single comparison, the length and one
+// character are enough to tell the known keys apart
+static int packageInfoKey(const char* key, int len)
+{
+	const char* expected;
+	int id;
+	switch(len)
+	{
+		case 4:
+			expected = "name";
+			id = KEY_NAME;
+			break;
+		case 7:
+			expected = "version";
+			id = KEY_VERSION;
+			break;
+		case 8:
+			if(key[4] == 'n')
+			{
+				expected = "ext_name";
+				id = KEY_EXT_NAME;
+			}
+			else
+			{
+				expected = "ext_prog";
+				id = KEY_EXT_PROG;
+			}
+			break;
+		case 9:
+			if(key[0] == 't')
+			{
+				expected = "timestamp";
+				id = KEY_TIMESTAMP;
+			}
+			else if(key[5] == 'n')
+			{
+				expected = "link_name";
+				id = KEY_LINK_NAME;
+			}
+			else
+			{
+				expected = "link_prog";
+				id = KEY_LINK_PROG;
+			}
+			break;
+		default:
+			return KEY_UNKNOWN;
+	}
+	return memcmp(key,expected,len) == 0 ? id : KEY_UNKNOWN;
+}
+
+static const char* skipLineBreaks(const char* p)
+{
+	while(*p == '\r' || *p == '\n')
+		p++;
+	return p;
+}
+
+static void copyValue(char* dest, int size, const char* value, int len)
+{
+	if(len > size - 1)
+		len = size - 1;
+	memcpy(dest,value,len);
+	dest[len] = '\0';
+}
+
+void freePackageInfo(pkginfo* p)
+{
+	free(p);
+}
+
+// The name of a package is the name of its folder in /pacspire, anything that
+// would point elsewhere is refused
+int isValidPackageName(const char* name)
+{
+	int len = strlen(name);
+	if(len == 0 || len > 20 || strchr(name,'/') != NULL)
+		return 0;
+	return strcmp(name,".") != 0 && strcmp(name,"..") != 0;
+}
+
+pkginfo* parsePackageInfo(const char* buffer)
+{
+	const char* line;
+	const char* next;
+	
+	// Count the entries first so that the arrays can be allocated together
+	// with the pkginfo instead of growing them line by line
+	int ext_max = 0;
+	int link_max = 0;
+	for(line = skipLineBreaks(buffer); *line != '\0'; line = skipLineBreaks(line + strcspn(line,"\r\n")))
+	{
+		if(strncmp(line,"ext_name=",9) == 0)
+			ext_max++;
+		else if(strncmp(line,"link_name=",10) == 0)
+			link_max++;
+	}
+	
+	pkginfo* p = malloc(sizeof(pkginfo) + ext_max * sizeof(fileext) + link_max * sizeof(link));
+	if(p == NULL)
+		return NULL;
+	p->name[0] = '\0';
+	p->version[0] = '\0';
+	p->timestamp = 0;
+	p->ext_count = 0;
+	p->extensions = (fileext*)(p + 1);
+	p->link_count = 0;
+	p->links = (link*)(p->extensions + ext_max);
+	p->installed_size = 0;
+	p->entry_count = 0;
+	p->pkginfo_crc = 0;
+	p->pkginfo_size = 0;
+	
+	for(line = skipLineBreaks(buffer); *line != '\0'; line = next)
+	{
+		int len = strcspn(line,"\r\n");
+		next = skipLineBreaks(line + len);
+		
+		const char* delimiter = memchr(line,'=',len);
+		if(delimiter == NULL)
+		{
+			free(p);
+			return NULL;
+		}
+		
+		int key_len = delimiter - line;
+		const char* value = delimiter + 1;
+		int value_len = len - key_len - 1;
+		switch(packageInfoKey(line,key_len))
+		{
+			case KEY_NAME:
+				copyValue(p->name,sizeof(p->name),value,value_len);
+				break;
+			
+			case KEY_VERSION:
+				copyValue(p->version,sizeof(p->version),value,value_len);
+				break;
+			
+			case KEY_TIMESTAMP:
+				// strtoul would skip whitespace into the next line
+				if(value_len > 0 && value[0] >= '0' && value[0] <= '9')
+					p->timestamp = (unsigned int)strtoul(value,NULL,0);
+				if(p->timestamp == 0)
+				{
+					free(p);
+					return NULL;
+				}
+				break;
+			
+			case KEY_EXT_NAME:
+				copyValue(p->extensions[p->ext_count].extension,sizeof(p->extensions[0].extension),value,value_len);
+				p->extensions[p->ext_count].program[0] = '\0';
+				p->ext_count++;
+				break;
+			
+			case KEY_EXT_PROG:
+				// ext_prog belongs to the ext_name above it
+				if(p->ext_count == 0)
+				{
+					free(p);
+					return NULL;
+				}
+				copyValue(p->extensions[p->ext_count-1].program,sizeof(p->extensions[0].program),value,value_len);
+				break;
+			
+			case KEY_LINK_NAME:
+				copyValue(p->links[p->link_count].name,sizeof(p->links[0].name),value,value_len);
+				p->links[p->link_count].program[0] = '\0';
+				p->link_count++;
+				break;
+			
+			case KEY_LINK_PROG:
+				if(p->link_count == 0)
+				{
+					free(p);
+					return NULL;
+				}
+				copyValue(p->links[p->link_count-1].program,sizeof(p->links[0].program),value,value_len);
+				break;
+			
+			default:
+				free(p);
+				return NULL;
+		}
+	}
+	
+	if(p->name[0] == '\0' || p->version[0] == '\0' || p->timestamp == 0)
+	{
+		free(p);
+		return NULL;
+	}
+	
+	int i;
+	for(i = 0; i < p->ext_count; i++)
+	{
+		if(p->extensions[i].extension[0] == '\0' || p->extensions[i].program[0] == '\0')
+		{
+			free(p);
+			return NULL;
+		}
+	}
+	for(i = 0; i < p->link_count; i++)
+	{
+		if(p->links[i].name[0] == '\0' || p->links[i].program[0] == '\0')
+		{
+			free(p);
+			return NULL;
+		}
+	}
+	
+	return p;
+}
+
+// The record pcsbuild writes into the comment of a package, so that pacspire knows
+// what it is about to install without inflating pkginfo.txt.tns. Numbers are little
+// endian, strings are their length in one byte followed by their characters:
+//   "PCSR", version (1), extension count (2), link count (2), timestamp (4),
+//   installed size (4), entry count (4), CRC32 (4) and size (4) of pkginfo.txt.tns,
+//   name, version, extension and program of each extension, name and program of each link
+#define RECORD_MAGIC "PCSR"
+#define RECORD_VERSION 2 // 1 did not have the CRC32 and size of pkginfo.txt.tns
+#define RECORD_HEADER_SIZE 29
+
+static unsigned int getLE(const unsigned char* p, int bytes)
+{
+	unsigned int value = 0;
+	while(bytes-- > 0)
+		value = (value << 8) | p[bytes];
+	return value;
+}
+
+static void putLE(unsigned char* p, unsigned int value, int bytes)
+{
+	int i;
+	for(i = 0; i < bytes; i++)
+		p[i] = (value >> (8 * i)) & 0xff;
+}
+
+// Strings that would not fit their field make the whole record invalid
+static const unsigned char* getString(const unsigned char* p, const unsigned char* end, char* dest, int size)
+{
+	if(p == NULL || p >= end || p[0] > size - 1 || p[0] > end - p - 1)
+		return NULL;
+	memcpy(dest,p + 1,p[0]);
+	dest[p[0]] = '\0';
+	return p + 1 + p[0];
+}
+
+static unsigned char* putString(unsigned char* p, const unsigned char* end, const char* s)
+{
+	int len = strlen(s);
+	if(p == NULL || len > 255 || len + 1 > end - p)
+		return NULL;
+	p[0] = len;
+	memcpy(p + 1,s,len);
+	return p + 1 + len;
+}
+
+// Takes the same checks as parsePackageInfo, NULL if the buffer is not a valid record
+pkginfo* parsePackageRecord(const void* buffer, int size)
+{
+	const unsigned char* data = buffer;
+	const unsigned char* end = data + size;
+	if(size < RECORD_HEADER_SIZE || memcmp(data,RECORD_MAGIC,4) != 0 || data[4] != RECORD_VERSION)
+		return NULL;
+	
+	int ext_count = getLE(data + 5,2);
+	int link_count = getLE(data + 7,2);
+	// Every string takes at least its length and one character, so a short
+	// record cannot make the calculator allocate for thousands of entries
+	if(RECORD_HEADER_SIZE + 4 + 4 * (ext_count + link_count) > size)
+		return NULL;
+	pkginfo* p = malloc(sizeof(pkginfo) + ext_count * sizeof(fileext) + link_count * sizeof(link));
+	if(p == NULL)
+		return NULL;
+	p->timestamp = getLE(data + 9,4);
+	p->installed_size = getLE(data + 13,4);
+	p->entry_count = getLE(data + 17,4);
+	p->pkginfo_crc = getLE(data + 21,4);
+	p->pkginfo_size = getLE(data + 25,4);
+	p->ext_count = ext_count;
+	p->extensions = (fileext*)(p + 1);
+	p->link_count = link_count;
+	p->links = (link*)(p->extensions + ext_count);
+	
+	const unsigned char* pos = data + RECORD_HEADER_SIZE;
+	pos = getString(pos,end,p->name,sizeof(p->name));
+	pos = getString(pos,end,p->version,sizeof(p->version));
+	int i;
+	for(i = 0; i < ext_count; i++)
+	{
+		pos = getString(pos,end,p->extensions[i].extension,sizeof(p->extensions[0].extension));
+		pos = getString(pos,end,p->extensions[i].program,sizeof(p->extensions[0].program));
+		if(pos != NULL && (p->extensions[i].extension[0] == '\0' || p->extensions[i].program[0] == '\0'))
+			pos = NULL;
+	}
+	for(i = 0; i < link_count; i++)
+	{
+		pos = getString(pos,end,p->links[i].name,sizeof(p->links[0].name));
+		pos = getString(pos,end,p->links[i].program,sizeof(p->links[0].program));
+		if(pos != NULL && (p->links[i].name[0] == '\0' || p->links[i].program[0] == '\0'))
+			pos = NULL;
+	}
+	
+	if(pos != end || p->name[0] == '\0' || p->version[0] == '\0' || p->timestamp == 0)
+	{
+		free(p);
+		return NULL;
+	}
+	return p;
+}
+
+// Returns the size of the record, -1 if it does not fit into the buffer
+int writePackageRecord(void* buffer, int size, const pkginfo* p)
+{
+	unsigned char* data = buffer;
+	const unsigned char* end = data + size;
+	if(size < RECORD_HEADER_SIZE || p->ext_count > 0xffff || p->link_count > 0xffff)
+		return -1;
+	
+	memcpy(data,RECORD_MAGIC,4);
+	data[4] = RECORD_VERSION;
+	putLE(data + 5,p->ext_count,2);
+	putLE(data + 7,p->link_count,2);
+	putLE(data + 9,p->timestamp,4);
+	putLE(data + 13,p->installed_size,4);
+	putLE(data + 17,p->entry_count,4);
+	putLE(data + 21,p->pkginfo_crc,4);
+	putLE(data + 25,p->pkginfo_size,4);
+	
+	unsigned char* pos = data + RECORD_HEADER_SIZE;
+	pos = putString(pos,end,p->name);
+	pos = putString(pos,end,p->version);
+	int i;
+	for(i = 0; i < p->ext_count; i++)
+	{
+		pos = putString(pos,end,p->extensions[i].extension);
+		pos = putString(pos,end,p->extensions[i].program);
+	}
+	for(i = 0; i < p->link_count; i++)
+	{
+		pos = putString(pos,end,p->links[i].name);
+		pos = putString(pos,end,p->links[i].program);
+	}
+	return pos != NULL ? pos - data : -1;
+}
@@ -0,0 +1,42 @@
+#ifndef PKGINFO_H
+#define PKGINFO_H
+
+typedef struct
+{
+	char extension[15];
+	char program[15];
+} fileext;
+
+typedef struct
+{
+	char name[30];
+	char program[15];
+} link;
+
+// extensions and links live in the same allocation as the pkginfo itself
+typedef struct
+{
+	char name[21];
+	char version[11];
+	unsigned int timestamp;
+	
+	int ext_count;
+	fileext* extensions;
+	
+	int link_count;
+	link* links;
+	
+	// only known from the record in the comment of a package, 0 otherwise
+	unsigned int installed_size;
+	unsigned int entry_count;
+	unsigned int pkginfo_crc; // of pkginfo.txt.tns, to tell whether the record still describes it
+	unsigned int pkginfo_size;
+} pkginfo;
+
+pkginfo* parsePackageInfo(const char* buffer);
+pkginfo* parsePackageRecord(const void* buffer, int size);
+int writePackageRecord(void* buffer, int size, const pkginfo* p);
+void freePackageInfo(pkginfo* p);
+int isValidPackageName(const char* name);
+
+#endif
@@ -0,0 +1,300 @@
+#include <os.h>
+#include <stdarg.h>
+#include "platform.h"
+
+#define TITLE "pacspire"
+
+#ifdef _TINSPIRE
+
+#include <nspireio.h>
+
+#define DEBUG_CONSOLE 0
+
+static nio_console console;
+static const int colors[] = {NIO_COLOR_BLACK,NIO_COLOR_GREEN,NIO_COLOR_YELLOW,NIO_COLOR_RED};
+
+void platformInit(void)
+{
+	assert_ndless_rev(877);
+	
+	#if DEBUG_CONSOLE == 1
+	clrscr();
+	nio_init(&console,NIO_MAX_COLS,NIO_MAX_ROWS,0,0,NIO_COLOR_WHITE,NIO_COLOR_BLACK,TRUE);
+	#else
+	nio_init(&console,NIO_MAX_COLS,NIO_MAX_ROWS,0,0,NIO_COLOR_WHITE,NIO_COLOR_BLACK,FALSE);
+	#endif
+	nio_set_default(&console);
+}
+
+void platformExit(void)
+{
+	nio_free(&console);
+	refresh_osscr();
+}
+
+void consolePrintf(const char* format, ...)
+{
+	char text[256];
+	va_list args;
+	va_start(args,format);
+	vsnprintf(text,sizeof(text),format,args);
+	va_end(args);
+	nio_printf("%s",text);
+}
+
+void consoleColor(int color)
+{
+	nio_color(&console,NIO_COLOR_WHITE,colors[color]);
+}
+
+void consoleClear(void)
+{
+	nio_clear(&console);
+}
+
+void consoleFlush(void)
+{
+	nio_fflush(&console);
+}
+
+int waitKey(void)
+{
+	wait_key_pressed();
+	int stop = isKeyPressed(KEY_NSPIRE_ESC);
+	wait_no_key_pressed();
+	return !stop;
+}
+
+void showMessage(const char* message)
+{
+	show_msgbox(TITLE,message);
+}
+
+int showDialog(const char* message, const char* button1, const char* button2, const char* button3)
+{
+	if(button3 == NULL)
+		return show_msgbox_2b(TITLE,message,button1,button2);
+	return show_msgbox_3b(TITLE,message,button1,button2,button3);
+}
+
+int askInput(const char* message, char** value)
+{
+	return show_msg_user_input(TITLE,message,"",value);
+}
+
+void registerFileExtension(const char* extension, const char* program)
+{
+	cfg_register_fileext(extension,program);
+}
+
+int runProgram(const char* path)
+{
+	return nl_exec(path,0,NULL);
+}
+
+#else
+
+#include <unistd.h>
+
+#define NDLESS_CFG "/documents/ndless/ndless.cfg.tns"
+
+static const char* root;
+static char paths[2][300];
+static int tty;
+
+static const char* hostPath(const char* path, int slot)
+{
+	if(path[0] != '/')
+		return path;
+	snprintf(paths[slot],sizeof(paths[slot]),"%s%s",root,path);
+	return paths[slot];
+}
+
+void platformInit(void)
+{
+	root = getenv("PACSPIRE_FS");
+	if(root == NULL)
+		root = ".";
+	tty = isatty(STDOUT_FILENO);
+}
+
+void platformExit(void)
+{
+	fflush(stdout);
+}
+
+FILE* fsOpen(const char* path, const char* mode)
+{
+	return fopen(hostPath(path,0),mode);
+}
+
+int fsStat(const char* path, struct stat* s)
+{
+	return stat(hostPath(path,0),s);
+}
+
+int fsMkdir(const char* path)
+{
+	return mkdir(hostPath(path,0),0755);
+}
+
+int fsUnlink(const char* path)
+{
+	return unlink(hostPath(path,0));
+}
+
+int fsRmdir(const char* path)
+{
+	return rmdir(hostPath(path,0));
+}
+
+int fsRename(const char* from, const char* to)
+{
+	return rename(hostPath(from,0),hostPath(to,1));
+}
+
+DIR* fsOpenDir(const char* path)
+{
+	return opendir(hostPath(path,0));
+}
+
+const char* fsPath(const char* path)
+{
+	return hostPath(path,0);
+}
+
+void consolePrintf(const char* format, ...)
+{
+	va_list args;
+	va_start(args,format);
+	vprintf(format,args);
+	va_end(args);
+}
+
+void consoleColor(int color)
+{
+	static const char* codes[] = {"\033[0m","\033[32m","\033[33m","\033[31m"};
+	if(tty)
+		fputs(codes[color],stdout);
+}
+
+void consoleClear(void)
+{
+	if(tty)
+		fputs("\033[H\033[2J",stdout);
+}
+
+void consoleFlush(void)
+{
+	fflush(stdout);
+}
+
+// Only waits on a terminal, q stops
+int waitKey(void)
+{
+	if(!isatty(STDIN_FILENO))
+		return 1;
+	fflush(stdout);
+	int c = getchar();
+	int stop = c == 'q';
+	while(c != '\n' && c != EOF)
+		c = getchar();
+	return !stop;
+}
+
+void showMessage(const char* message)
+{
+	fflush(stdout);
+	fprintf(stderr,"[%s] %s\n",TITLE,message);
+}
+
+// Reads the number of the button from stdin, the first one at the end of the input
+int showDialog(const char* message, const char* button1, const char* button2, const char* button3)
+{
+	fflush(stdout);
+	fprintf(stderr,"[%s] %s\n  1) %s  2) %s",TITLE,message,button1,button2);
+	if(button3 != NULL)
+		fprintf(stderr,"  3) %s",button3);
+	fprintf(stderr,"\n> ");
+	
+	char line[16];
+	int button = 1;
+	if(fgets(line,sizeof(line),stdin) != NULL)
+		button = atoi(line);
+	if(button < 1 || button > (button3 != NULL ? 3 : 2))
+		button = 1;
+	fprintf(stderr,"%d\n",button);
+	return button;
+}
+
+int askInput(const char* message, char** value)
+{
+	fflush(stdout);
+	fprintf(stderr,"[%s] %s\n> ",TITLE,message);
+	
+	char line[100];
+	if(fgets(line,sizeof(line),stdin) == NULL)
+		return -1;
+	line[strcspn(line,"\r\n")] = '\0';
+	fprintf(stderr,"%s\n",line);
+	*value = malloc(strlen(line) + 1);
+	if(*value == NULL)
+		return -1;
+	strcpy(*value,line);
+	return strlen(line);
+}
+
+// Rewrites ndless.cfg the way Ndless does, with one ext.<extension>=<program> line per extension
+void registerFileExtension(const char* extension, const char* program)
+{
+	char* content = NULL;
+	long size = 0;
+	FILE* f = fsOpen(NDLESS_CFG,"rb");
+	if(f != NULL)
+	{
+		fseek(f,0,SEEK_END);
+		size = ftell(f);
+		fseek(f,0,SEEK_SET);
+		content = malloc(size + 1);
+		if(content == NULL || fread(content,1,size,f) != (size_t)size)
+		{
+			// Rewriting it now would lose every other extension
+			free(content);
+			fclose(f);
+			return;
+		}
+		content[size] = '\0';
+		fclose(f);
+	}
+	
+	f = fsOpen(NDLESS_CFG,"wb");
+	if(f == NULL)
+	{
+		free(content);
+		return;
+	}
+	
+	char key[40];
+	snprintf(key,sizeof(key),"ext.%s=",extension);
+	long pos = 0;
+	while(pos < size)
+	{
+		long len = strcspn(content + pos,"\n");
+		if(pos + len < size)
+			len++;
+		if(strncmp(content + pos,key,strlen(key)) != 0)
+			fwrite(content + pos,1,len,f);
+		pos += len;
+	}
+	fprintf(f,"%s%s\n",key,program);
+	fclose(f);
+	free(content);
+}
+
+int runProgram(const char* path)
+{
+	fprintf(stderr,"[%s] %s cannot be run on this platform\n",TITLE,path);
+	return -1;
+}
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+// Everything pacspire needs from the calculator, implemented in platform.c with
+// Ndless and, for builds on a PC, with POSIX calls on a directory standing in
+// for the calculator filesystem (PACSPIRE_FS, the current directory by default)
+
+void platformInit(void);
+void platformExit(void);
+
+// Files. Paths are calculator paths, on a PC absolute ones are looked up under
+// PACSPIRE_FS and relative ones in the current directory.
+#ifdef _TINSPIRE
+#define fsOpen(path, mode) fopen(path,mode)
+#define fsStat(path, s) stat(path,s)
+#define fsMkdir(path) mkdir(path,0755)
+#define fsUnlink(path) unlink(path)
+#define fsRmdir(path) rmdir(path)
+#define fsRename(from, to) rename(from,to)
+#define fsOpenDir(path) opendir(path)
+#define fsPath(path) (path)
+#else
+FILE* fsOpen(const char* path, const char* mode);
+int fsStat(const char* path, struct stat* s);
+int fsMkdir(const char* path);
+int fsUnlink(const char* path);
+int fsRmdir(const char* path);
+int fsRename(const char* from, const char* to);
+DIR* fsOpenDir(const char* path);
+const char* fsPath(const char* path); // for other libraries, valid until the next call
+#endif
+
+// Console, drawn only where the platform has one
+#define CONSOLE_COLS 53
+#define CONSOLE_ROWS 30
+
+enum
+{
+	CONSOLE_PLAIN,
+	CONSOLE_GREEN,
+	CONSOLE_YELLOW,
+	CONSOLE_RED
+};
+
+void consolePrintf(const char* format, ...);
+void consoleColor(int color);
+void consoleClear(void);
+void consoleFlush(void);
+int waitKey(void); // returns 0 when the user wants to stop (ESC)
+
+// Dialogs, the buttons are numbered from 1
+void showMessage(const char* message);
+int showDialog(const char* message, const char* button1, const char* button2, const char* button3); // button3 may be NULL
+int askInput(const char* message, char** value); // returns -1 if cancelled, value is malloced
+
+void registerFileExtension(const char* extension, const char* program);
+int runProgram(const char* path);
+
+#endif
@@ -0,0 +1,82 @@
+#include <os.h>
+#include "profile.h"
+#include "timer.h"
+#include "platform.h"
+
+static const char* phase_names[] = {"other","open","pkginfo","index","dialog","entries","mkdir","inflate","crc","write","commit","manifest","extensions","links","console"};
+static const char* counter_names[] = {"in","out","files","dirs"};
+
+static unsigned int phase_time[PHASE_COUNT];
+static unsigned long counters[COUNTER_COUNT];
+static int current = PHASE_OTHER;
+static unsigned int last_switch;
+static unsigned int slowest_time;
+static char slowest_name[50];
+
+void profileReset(void)
+{
+	memset(phase_time,0,sizeof(phase_time));
+	memset(counters,0,sizeof(counters));
+	current = PHASE_OTHER;
+	last_switch = getMicroseconds();
+	slowest_time = 0;
+	slowest_name[0] = '\0';
+}
+
+int profileEnter(int phase)
+{
+	unsigned int now = getMicroseconds();
+	phase_time[current] += now - last_switch;
+	last_switch = now;
+	
+	int previous = current;
+	current = phase;
+	return previous;
+}
+
+void profileCount(int counter, unsigned long amount)
+{
+	counters[counter] += amount;
+}
+
+void profileEntry(const char* name, unsigned int time)
+{
+	if(time >= slowest_time)
+	{
+		slowest_time = time;
+		strncpy(slowest_name,name,sizeof(slowest_name) - 1);
+	}
+}
+
+unsigned int profileTime(int phase)
+{
+	if(phase == current)
+		return phase_time[phase] + getMicroseconds() - last_switch;
+	return phase_time[phase];
+}
+
+int profileAppend(const char* file, const char* label, const char* result, const char* build)
+{
+	profileEnter(current); // charge the current phase up to now
+	
+	unsigned int total = 0;
+	int i;
+	for(i = 0; i < PHASE_COUNT; i++)
+		if(i != PHASE_DIALOG)
+			total += phase_time[i];
+	
+	FILE* f = fsOpen(file,"ab");
+	if(f == NULL)
+		return -1;
+	fprintf(f,"%s | %s | %s | total=%u",label,result,build,total);
+	for(i = 0; i < PHASE_COUNT; i++)
+		fprintf(f," %s=%u",phase_names[i],phase_time[i]);
+	fprintf(f," |");
+	for(i = 0; i < COUNTER_COUNT; i++)
+		fprintf(f," %s=%lu",counter_names[i],counters[i]);
+	fprintf(f," | slowest=%s:%u\n",slowest_name,slowest_time);
+	
+	if(fclose(f) != 0)
+		return -1;
+	return 0;
+}
@@ -0,0 +1,43 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+// Where the time of a run goes. Exactly one phase is current at any time and
+// gets the time until the next switch, so nested phases are not counted twice.
+enum
+{
+	PHASE_OTHER, // startup, argument parsing and everything not listed below
+	PHASE_OPEN, // unzOpen and reading the central directory
+	PHASE_PKGINFO, // locating, unzipping and parsing the pkginfo
+	PHASE_INDEX, // loading and saving the package index
+	PHASE_DIALOG, // waiting for the user, not part of the total
+	PHASE_ENTRIES, // walking the entries and comparing them to the manifest
+	PHASE_MKDIR,
+	PHASE_INFLATE, // unzReadCurrentFile, including the reads from the package
+	PHASE_CRC,
+	PHASE_WRITE, // fopen, fwrite and fclose of the extracted files
+	PHASE_COMMIT, // moving staged files into place and removing old ones
+	PHASE_MANIFEST,
+	PHASE_EXTENSIONS, // cfg_register_fileext
+	PHASE_LINKS,
+	PHASE_CONSOLE, // drawing the log
+	PHASE_COUNT
+};
+
+enum
+{
+	COUNTER_BYTES_IN, // compressed bytes of the extracted entries
+	COUNTER_BYTES_OUT,
+	COUNTER_FILES,
+	COUNTER_DIRS,
+	COUNTER_COUNT
+};
+
+void profileReset(void);
+int profileEnter(int phase); // returns the phase that was current, to go back to it
+void profileCount(int counter, unsigned long amount);
+void profileEntry(const char* name, unsigned int time); // time of one extracted entry in us, keeps the slowest
+unsigned int profileTime(int phase); // us spent in a phase so far
+// Appends one line with every phase in us, the counters and the slowest entry
+int profileAppend(const char* file, const char* label, const char* result, const char* build);
+
+#endif
@@ -0,0 +1,92 @@
+#include <os.h>
+#include "timer.h"
+
+#ifdef _TINSPIRE
+
+// Second SP804 timer of the CX, clocked at 32768 Hz
+#define TIMER_LOAD ((volatile unsigned int*)0x900D0000)
+#define TIMER_VALUE ((volatile unsigned int*)0x900D0004)
+#define TIMER_CONTROL ((volatile unsigned int*)0x900D0008)
+#define TIMER_FREQUENCY 32768
+// Real time clock, counts seconds
+#define RTC_VALUE ((volatile unsigned int*)0x90090000)
+
+static unsigned int saved_load;
+static unsigned int saved_control;
+static unsigned int start;
+
+void initTimer(void)
+{
+	if(is_cx)
+	{
+		saved_load = *TIMER_LOAD;
+		saved_control = *TIMER_CONTROL;
+		*TIMER_CONTROL = 0; // stop it while it is reconfigured
+		*TIMER_LOAD = 0xFFFFFFFF;
+		*TIMER_CONTROL = 0x82; // enabled, free running, 32 bit, no prescaler
+		start = *TIMER_VALUE;
+	}
+	else
+		start = *RTC_VALUE;
+}
+
+void restoreTimer(void)
+{
+	if(is_cx)
+	{
+		*TIMER_CONTROL = 0;
+		*TIMER_LOAD = saved_load;
+		*TIMER_CONTROL = saved_control;
+	}
+}
+
+unsigned int getMilliseconds(void)
+{
+	if(is_cx)
+	{
+		// The timer counts down
+		unsigned int ticks = start - *TIMER_VALUE;
+		return (ticks / TIMER_FREQUENCY) * 1000 + (ticks % TIMER_FREQUENCY) * 1000 / TIMER_FREQUENCY;
+	}
+	return (*RTC_VALUE - start) * 1000;
+}
+
+unsigned int getMicroseconds(void)
+{
+	if(is_cx)
+		return (unsigned int)((unsigned long long)(start - *TIMER_VALUE) * 1000000 / TIMER_FREQUENCY);
+	return (*RTC_VALUE - start) * 1000000;
+}
+
+#else
+
+// Wall time, clock() would leave out the time spent waiting for the file system
+static struct timespec start;
+
+static unsigned long long elapsedMicroseconds(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC,&now);
+	return (unsigned long long)(now.tv_sec - start.tv_sec) * 1000000 + now.tv_nsec / 1000 - start.tv_nsec / 1000;
+}
+
+void initTimer(void)
+{
+	clock_gettime(CLOCK_MONOTONIC,&start);
+}
+
+void restoreTimer(void)
+{
+}
+
+unsigned int getMilliseconds(void)
+{
+	return (unsigned int)(elapsedMicroseconds() / 1000);
+}
+
+unsigned int getMicroseconds(void)
+{
+	return (unsigned int)elapsedMicroseconds();
+}
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+// Clock for the timings in the log. On the calculator it runs on
+// the 32 kHz CX timer (RTC seconds on older models), elsewhere on the monotonic clock.
+void initTimer(void);
+void restoreTimer(void);
+unsigned int getMilliseconds(void);
+unsigned int getMicroseconds(void); // wraps after about an hour, only use differences
+
+#endif
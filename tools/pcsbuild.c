@@ -0,0 +1,400 @@
+#include <os.h>
+#include "pkginfo.h"
+#include "zipwriter.h"
+
+// Builds a package from a directory: pkginfo.txt.tns comes first, then every
+// directory before its contents, sorted by name, so that pacspire reads the
+// package in a single pass. Entries that deflate badly are stored. The comment of
+// the archive holds the pkginfo as a record, so that pacspire does not need to
+// inflate pkginfo.txt.tns to ask the user.
+
+#define PKGINFO_ENTRY "pkginfo.txt.tns"
+
+typedef struct
+{
+	zipentry zip;
+	char* source; // NULL for directories and the pkginfo
+} entry;
+
+typedef struct
+{
+	int count;
+	int capacity;
+	entry* entries;
+} entrylist;
+
+typedef struct
+{
+	const char* key;
+	int max;
+} valuelimit;
+
+// the sizes of the fields of pkginfo minus the terminator, parsePackageInfo cuts longer values
+static const valuelimit limits[] = {
+	{"name",20},
+	{"version",10},
+	{"timestamp",10},
+	{"ext_name",14},
+	{"ext_prog",14},
+	{"link_name",29},
+	{"link_prog",14}
+};
+
+static char* readFile(const char* path, unsigned int* size)
+{
+	FILE* f = fopen(path,"rb");
+	if(f == NULL)
+		return NULL;
+	fseek(f,0,SEEK_END);
+	long len = ftell(f);
+	fseek(f,0,SEEK_SET);
+	char* data = malloc(len + 1);
+	if(data == NULL || fread(data,1,len,f) != (size_t)len)
+	{
+		free(data);
+		fclose(f);
+		return NULL;
+	}
+	data[len] = '\0';
+	fclose(f);
+	*size = len;
+	return data;
+}
+
+static int addEntry(entrylist* list, const char* path, const char* source, int is_dir)
+{
+	if(strlen(path) > ZIP_MAX_PATH)
+	{
+		fprintf(stderr,"%s: path longer than %d characters\n",path,ZIP_MAX_PATH);
+		return -1;
+	}
+	if(list->count == list->capacity)
+	{
+		int capacity = list->capacity == 0 ? 64 : list->capacity * 2;
+		entry* entries = realloc(list->entries,capacity * sizeof(entry));
+		if(entries == NULL)
+			return -1;
+		list->entries = entries;
+		list->capacity = capacity;
+	}
+	
+	entry* e = &list->entries[list->count++];
+	memset(e,0,sizeof(entry));
+	strcpy(e->zip.path,path);
+	e->zip.is_dir = is_dir;
+	if(source != NULL)
+	{
+		e->source = malloc(strlen(source) + 1);
+		if(e->source == NULL)
+			return -1;
+		strcpy(e->source,source);
+	}
+	return 0;
+}
+
+static int compareNames(const void* a, const void* b)
+{
+	return strcmp(*(char* const*)a,*(char* const*)b);
+}
+
+// Adds the contents of a directory, each subdirectory followed by its own contents.
+// Hidden files are left out.
+static int addDirectory(entrylist* list, const char* source_dir, const char* prefix)
+{
+	DIR* d = opendir(source_dir);
+	if(d == NULL)
+	{
+		fprintf(stderr,"%s: %s\n",source_dir,strerror(errno));
+		return -1;
+	}
+	
+	int count = 0;
+	int capacity = 0;
+	char** names = NULL;
+	struct dirent* de;
+	while((de = readdir(d)) != NULL)
+	{
+		if(de->d_name[0] == '.')
+			continue;
+		// the pkginfo of the source directory becomes the first entry
+		if(prefix[0] == '\0' && (strcmp(de->d_name,"pkginfo.txt") == 0 || strcmp(de->d_name,PKGINFO_ENTRY) == 0))
+			continue;
+		if(count == capacity)
+		{
+			capacity = capacity == 0 ? 32 : capacity * 2;
+			char** grown = realloc(names,capacity * sizeof(char*));
+			if(grown == NULL)
+				break;
+			names = grown;
+		}
+		names[count] = malloc(strlen(de->d_name) + 1);
+		if(names[count] == NULL)
+			break;
+		strcpy(names[count++],de->d_name);
+	}
+	closedir(d);
+	qsort(names,count,sizeof(char*),compareNames);
+	
+	int result = 0;
+	int i;
+	for(i = 0; i < count && result == 0; i++)
+	{
+		char source[300];
+		char path[300];
+		struct stat s;
+		snprintf(source,sizeof(source),"%s/%s",source_dir,names[i]);
+		if(stat(source,&s) == -1)
+		{
+			fprintf(stderr,"%s: %s\n",source,strerror(errno));
+			result = -1;
+		}
+		else if(S_ISDIR(s.st_mode))
+		{
+			snprintf(path,sizeof(path),"%s%s/",prefix,names[i]);
+			if(addEntry(list,path,NULL,1) == -1 || addDirectory(list,source,path) == -1)
+				result = -1;
+		}
+		else if(S_ISREG(s.st_mode))
+		{
+			snprintf(path,sizeof(path),"%s%s",prefix,names[i]);
+			if(addEntry(list,path,source,0) == -1)
+				result = -1;
+		}
+	}
+	
+	for(i = 0; i < count; i++)
+		free(names[i]);
+	free(names);
+	return result;
+}
+
+static entry* findEntry(entrylist* list, const char* path)
+{
+	int i;
+	for(i = 0; i < list->count; i++)
+	{
+		if(strcmp(list->entries[i].zip.path,path) == 0)
+			return &list->entries[i];
+	}
+	return NULL;
+}
+
+// Reports the lines parsePackageInfo would reject or cut, it does not tell why it fails
+static int checkPackageInfoLines(const char* buffer, const char* file)
+{
+	int errors = 0;
+	int number = 0;
+	const char* line = buffer;
+	while(*line != '\0')
+	{
+		int len = strcspn(line,"\r\n");
+		number++;
+		if(len > 0)
+		{
+			const char* delimiter = memchr(line,'=',len);
+			unsigned int i;
+			for(i = 0; delimiter != NULL && i < sizeof(limits) / sizeof(limits[0]); i++)
+			{
+				if((int)strlen(limits[i].key) == delimiter - line && strncmp(line,limits[i].key,delimiter - line) == 0)
+					break;
+			}
+			if(delimiter == NULL)
+			{
+				fprintf(stderr,"%s:%d: missing '='\n",file,number);
+				errors++;
+			}
+			else if(i == sizeof(limits) / sizeof(limits[0]))
+			{
+				fprintf(stderr,"%s:%d: unknown key %.*s\n",file,number,(int)(delimiter - line),line);
+				errors++;
+			}
+			else if(line + len - delimiter - 1 > limits[i].max)
+			{
+				fprintf(stderr,"%s:%d: %s is longer than %d characters\n",file,number,limits[i].key,limits[i].max);
+				errors++;
+			}
+		}
+		line += len;
+		if(*line == '\r')
+			line++;
+		if(*line == '\n')
+			line++;
+	}
+	return errors;
+}
+
+static int checkPackageInfo(const char* buffer, const char* file, pkginfo* p, entrylist* list)
+{
+	if(checkPackageInfoLines(buffer,file) > 0)
+		return -1;
+	if(p == NULL)
+	{
+		fprintf(stderr,"%s: needs name, version and a timestamp other than 0, and a program for every ext_name and link_name\n",file);
+		return -1;
+	}
+	
+	int errors = 0;
+	if(!isValidPackageName(p->name))
+	{
+		fprintf(stderr,"%s: the name is used as a folder name and cannot contain '/' or be . or ..\n",file);
+		errors++;
+	}
+	int i;
+	for(i = 0; i < p->link_count; i++)
+	{
+		entry* e = findEntry(list,p->links[i].program);
+		if(e == NULL || e->source == NULL)
+		{
+			fprintf(stderr,"%s: link %s runs %s, which is not a file of the package\n",file,p->links[i].name,p->links[i].program);
+			errors++;
+		}
+	}
+	return errors > 0 ? -1 : 0;
+}
+
+static void freeEntries(entrylist* list)
+{
+	int i;
+	for(i = 0; i < list->count; i++)
+		free(list->entries[i].source);
+	free(list->entries);
+}
+
+static int buildPackage(entrylist* list, pkginfo* p, const char* info, unsigned int info_size, const char* output)
+{
+	FILE* out = fopen(output,"wb");
+	if(out == NULL)
+	{
+		fprintf(stderr,"%s: %s\n",output,strerror(errno));
+		return -1;
+	}
+	
+	unsigned long long size = 0;
+	int deflated = 0;
+	int stored = 0;
+	int i;
+	for(i = 0; i < list->count; i++)
+	{
+		entry* e = &list->entries[i];
+		int result;
+		if(i == 0)
+			result = zipWriteEntry(out,&e->zip,info,info_size);
+		else if(e->zip.is_dir)
+			result = zipWriteEntry(out,&e->zip,"",0);
+		else
+		{
+			unsigned int data_size;
+			char* data = readFile(e->source,&data_size);
+			if(data == NULL)
+			{
+				fprintf(stderr,"%s: %s\n",e->source,strerror(errno));
+				fclose(out);
+				return -1;
+			}
+			result = zipWriteEntry(out,&e->zip,data,data_size);
+			free(data);
+		}
+		if(result == -1)
+		{
+			fprintf(stderr,"%s: write failed\n",output);
+			fclose(out);
+			return -1;
+		}
+		size += e->zip.size;
+		if(!e->zip.is_dir)
+		{
+			if(e->zip.method == 0)
+				stored++;
+			else
+				deflated++;
+		}
+	}
+	
+	unsigned int start = ftell(out);
+	for(i = 0; i < list->count; i++)
+	{
+		if(zipWriteCentralEntry(out,&list->entries[i].zip) == -1)
+			break;
+	}
+	
+	// The record goes into the comment of the archive, see parsePackageRecord
+	static unsigned char record[65535];
+	p->installed_size = size;
+	p->entry_count = list->count;
+	p->pkginfo_crc = list->entries[0].zip.crc;
+	p->pkginfo_size = list->entries[0].zip.size;
+	int record_size = writePackageRecord(record,sizeof(record),p);
+	if(record_size == -1)
+	{
+		fprintf(stderr,"%s: too many extensions and links for a package record, pacspire will read pkginfo.txt.tns\n",output);
+		record_size = 0;
+	}
+	int result = i < list->count || zipWriteEnd(out,list->count,start,record,record_size) == -1 ? -1 : 0;
+	if(fclose(out) != 0 || result == -1)
+	{
+		fprintf(stderr,"%s: write failed\n",output);
+		return -1;
+	}
+	printf("%s: %d entries, %d deflated, %d stored, %llu bytes installed, %d byte record\n",output,list->count,deflated,stored,size,record_size);
+	return 0;
+}
+
+int main(int argc, char** argv)
+{
+	if(argc != 2 && argc != 3)
+	{
+		fprintf(stderr,"usage: pcsbuild <directory> [output]\n"
+			"  the directory holds pkginfo.txt (or pkginfo.txt.tns) and the files of the package,\n"
+			"  the output is <name>.pcs.tns by default\n");
+		return 1;
+	}
+	const char* dir = argv[1];
+	
+	char info_file[300];
+	unsigned int info_size;
+	snprintf(info_file,sizeof(info_file),"%s/pkginfo.txt",dir);
+	char* info = readFile(info_file,&info_size);
+	if(info == NULL)
+	{
+		snprintf(info_file,sizeof(info_file),"%s/%s",dir,PKGINFO_ENTRY);
+		info = readFile(info_file,&info_size);
+	}
+	if(info == NULL)
+	{
+		fprintf(stderr,"%s: no pkginfo.txt or %s\n",dir,PKGINFO_ENTRY);
+		return 1;
+	}
+	
+	entrylist list;
+	list.count = 0;
+	list.capacity = 0;
+	list.entries = NULL;
+	if(addEntry(&list,PKGINFO_ENTRY,NULL,0) == -1 || addDirectory(&list,dir,"") == -1)
+	{
+		freeEntries(&list);
+		free(info);
+		return 1;
+	}
+	
+	pkginfo* p = parsePackageInfo(info);
+	if(checkPackageInfo(info,info_file,p,&list) == -1)
+	{
+		freePackageInfo(p);
+		freeEntries(&list);
+		free(info);
+		return 1;
+	}
+	
+	char output[300];
+	if(argc == 3)
+		snprintf(output,sizeof(output),"%s",argv[2]);
+	else
+		snprintf(output,sizeof(output),"%s.pcs.tns",p->name);
+	zipSetTime(p->timestamp);
+	
+	int result = buildPackage(&list,p,info,info_size,output);
+	freePackageInfo(p);
+	freeEntries(&list);
+	free(info);
+	return result == -1 ? 1 : 0;
+}
@@ -0,0 +1,148 @@
+#include <os.h>
+#include <zlib.h>
+#include "zipwriter.h"
+
+// The zip writer of pcsbuild. It is kept apart from pkginfo.h, whose link type
+// clashes with the link() of unistd.h that zconf.h includes.
+
+#define MIN_SAVING 10 // percent, a smaller saving is not worth inflating on the calculator
+
+static unsigned short dos_time;
+static unsigned short dos_date;
+
+static void put16(unsigned char* p, unsigned int value)
+{
+	p[0] = value & 0xff;
+	p[1] = (value >> 8) & 0xff;
+}
+
+static void put32(unsigned char* p, unsigned int value)
+{
+	put16(p,value & 0xffff);
+	put16(p + 2,value >> 16);
+}
+
+// Every entry gets the timestamp of the package, so that the same sources give the same package
+void zipSetTime(unsigned int timestamp)
+{
+	time_t t = timestamp;
+	struct tm* tm = gmtime(&t);
+	if(tm == NULL || tm->tm_year < 80)
+	{
+		dos_time = 0;
+		dos_date = (1 << 5) | 1;
+		return;
+	}
+	dos_time = (tm->tm_hour << 11) | (tm->tm_min << 5) | (tm->tm_sec / 2);
+	dos_date = ((tm->tm_year - 80) << 9) | ((tm->tm_mon + 1) << 5) | tm->tm_mday;
+}
+
+// Raw deflate as minizip expects it, NULL when it does not save MIN_SAVING percent
+static unsigned char* deflateData(const char* data, unsigned int size, unsigned int* compressed_size)
+{
+	if(size == 0)
+		return NULL;
+	
+	z_stream stream;
+	memset(&stream,0,sizeof(stream));
+	if(deflateInit2(&stream,Z_BEST_COMPRESSION,Z_DEFLATED,-MAX_WBITS,9,Z_DEFAULT_STRATEGY) != Z_OK)
+		return NULL;
+	unsigned long bound = deflateBound(&stream,size);
+	unsigned char* out = malloc(bound);
+	if(out == NULL)
+	{
+		deflateEnd(&stream);
+		return NULL;
+	}
+	stream.next_in = (unsigned char*)data;
+	stream.avail_in = size;
+	stream.next_out = out;
+	stream.avail_out = bound;
+	int result = deflate(&stream,Z_FINISH);
+	*compressed_size = stream.total_out;
+	deflateEnd(&stream);
+	
+	if(result != Z_STREAM_END || (unsigned long long)*compressed_size * 100 > (unsigned long long)size * (100 - MIN_SAVING))
+	{
+		free(out);
+		return NULL;
+	}
+	return out;
+}
+
+// Writes the local header and the data, deflated or stored, without a data descriptor
+int zipWriteEntry(FILE* out, zipentry* e, const char* data, unsigned int size)
+{
+	unsigned char* compressed = deflateData(data,size,&e->compressed_size);
+	e->method = compressed != NULL ? Z_DEFLATED : 0;
+	if(compressed == NULL)
+		e->compressed_size = size;
+	e->size = size;
+	e->crc = crc32(0,(const unsigned char*)data,size);
+	e->offset = ftell(out);
+	
+	unsigned char header[30];
+	put32(header,0x04034b50);
+	put16(header + 4,e->method == Z_DEFLATED ? 20 : 10);
+	put16(header + 6,0);
+	put16(header + 8,e->method);
+	put16(header + 10,dos_time);
+	put16(header + 12,dos_date);
+	put32(header + 14,e->crc);
+	put32(header + 18,e->compressed_size);
+	put32(header + 22,e->size);
+	put16(header + 26,strlen(e->path));
+	put16(header + 28,0);
+	
+	int result = 0;
+	if(fwrite(header,1,sizeof(header),out) != sizeof(header)
+		|| fwrite(e->path,1,strlen(e->path),out) != strlen(e->path)
+		|| fwrite(compressed != NULL ? (const char*)compressed : data,1,e->compressed_size,out) != e->compressed_size)
+		result = -1;
+	free(compressed);
+	return result;
+}
+
+int zipWriteCentralEntry(FILE* out, const zipentry* e)
+{
+	unsigned char header[46];
+	put32(header,0x02014b50);
+	put16(header + 4,(3 << 8) | 20); // made on Unix, for the attributes below
+	put16(header + 6,e->method == Z_DEFLATED ? 20 : 10);
+	put16(header + 8,0);
+	put16(header + 10,e->method);
+	put16(header + 12,dos_time);
+	put16(header + 14,dos_date);
+	put32(header + 16,e->crc);
+	put32(header + 20,e->compressed_size);
+	put32(header + 24,e->size);
+	put16(header + 28,strlen(e->path));
+	put16(header + 30,0);
+	put16(header + 32,0);
+	put16(header + 34,0);
+	put16(header + 36,0);
+	put32(header + 38,e->is_dir ? (040755u << 16) | 0x10 : 0100644u << 16);
+	put32(header + 42,e->offset);
+	if(fwrite(header,1,sizeof(header),out) != sizeof(header)
+		|| fwrite(e->path,1,strlen(e->path),out) != strlen(e->path))
+		return -1;
+	return 0;
+}
+
+// start is the offset of the first central directory entry, the comment is at most 65535 bytes
+int zipWriteEnd(FILE* out, int count, unsigned int start, const void* comment, unsigned int comment_size)
+{
+	unsigned char end[22];
+	put32(end,0x06054b50);
+	put16(end + 4,0);
+	put16(end + 6,0);
+	put16(end + 8,count);
+	put16(end + 10,count);
+	put32(end + 12,ftell(out) - start);
+	put32(end + 16,start);
+	put16(end + 20,comment_size);
+	if(fwrite(end,1,sizeof(end),out) != sizeof(end)
+		|| fwrite(comment,1,comment_size,out) != comment_size)
+		return -1;
+	return 0;
+}
@@ -0,0 +1,23 @@
+#ifndef ZIPWRITER_H
+#define ZIPWRITER_H
+
+#define ZIP_MAX_PATH 49 // extractPackage reads the names of the entries into 50 bytes
+
+typedef struct
+{
+	char path[ZIP_MAX_PATH + 1];
+	int is_dir;
+	// filled in by zipWriteEntry
+	unsigned short method;
+	unsigned int crc;
+	unsigned int compressed_size;
+	unsigned int size;
+	unsigned int offset;
+} zipentry;
+
+void zipSetTime(unsigned int timestamp);
+int zipWriteEntry(FILE* out, zipentry* e, const char* data, unsigned int size);
+int zipWriteCentralEntry(FILE* out, const zipentry* e);
+int zipWriteEnd(FILE* out, int count, unsigned int start, const void* comment, unsigned int comment_size);
+
+#endif